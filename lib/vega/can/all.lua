@@ -4,6 +4,11 @@ function can.pile()
     return __vega.mall.pile()
 end
 
+-- decoder of dumps written in pieces, values are read once complete
+function can.loader()
+    return __vega.mall.loader()
+end
+
 for _, module in ipairs{'io', 'misc', 'sync'} do
     table.merge(can, require('vega.can.' .. module))    
 end
@@ -6,9 +6,38 @@ function can.listener(options)
     options.host = options.host or 'localhost'
     options.port = options.port or 12000
     
+    if options.shard then return can.shard(options) end
+    
     return __vega.main.listener(options)
 end
 
+-- every line runs the script and so opens its own SO_REUSEPORT listener for the same
+-- host:port, the kernel spreads the connections over them. the listener of the current
+-- line is returned, and connections it accepts are passed to options.accept on this line
+function can.shard(options)
+    local accept = options.accept
+    
+    options.shard = nil
+    options.accept = nil
+    options.reuseport = 1
+    
+    local listener = __vega.main.listener(options)
+    
+    if accept then
+        run(function()
+            -- accept fails once the listener is closed
+            while true do
+                local ok, net = pcall(listener.accept, listener)
+                if not ok then break end
+                
+                run(function() accept(net) end)
+            end
+        end)
+    end
+    
+    return listener
+end
+
 
 function can.udp(options)
     return __vega.main.udp(parse(options))
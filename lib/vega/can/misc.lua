@@ -25,9 +25,12 @@ function can.string(length)
     return s
 end
 
-function can.dump(object)
+-- shared is what happens to a table or function reached again on another path:
+-- 'copy' dumps it again (default), 'once' dumps only the first one, 'error' fails,
+-- cycles are always cut
+function can.dump(object, shared)
     assert(object, "expecting passed object")
-    return __vega.set.dump(object)
+    return __vega.set.dump(object, shared)
 end
 
 function can.load(data)
@@ -42,8 +45,15 @@ function can.compare(left, right)
     return __vega.set.compare(left, right)
 end
 
-function can.info()
-    return __vega.set.info()
+-- structural hash of the object as 32 hex digits, equal objects have equal digests
+function can.digest(object)
+    assert(object ~= nil, "expecting passed object")
+    
+    return __vega.set.digest(object)
+end
+
+function can.info(line)
+    return __vega.set.info(line)
 end
 
 
@@ -1,9 +1,15 @@
 local common = {}
 
+local appended = setmetatable({}, {__mode = 'k'})
+
 function common.append(object, what)
     local target = object
     local mt = getmetatable(object)
     if mt then target = mt.__index end 
+    
+    -- instances share the methods of their class so those are wrapped only once
+    if appended[target] then return object end
+    appended[target] = true
 
     for name, method in pairs(target) do
         local overload = function(...)
@@ -13,8 +19,6 @@ function common.append(object, what)
         target[name] = overload
     end 
     
-    if mt then setmetatable(object, mt) end
-    
     return object
 end
 
@@ -33,7 +33,7 @@ end
 --- get all keys stored in the dictionary
 -- @return table with keys 
 dict.keys = function()
-    return __vega.dictionary.keys()
+    return __vega.dictionary.keys() or {}
 end
 
 return dict
\ No newline at end of file
@@ -0,0 +1,97 @@
+--- Calls hot api methods through the luajit ffi so loops using them stay jit compiled
+-- @module vega.ffi
+
+local loaded, ffi = pcall(require, 'ffi')
+if not loaded then return false end
+
+-- declarations come from vega so they always match the binary
+if not pcall(ffi.cdef, __vega.set.declarations()) then return false end
+
+local C = ffi.C
+if not pcall(function() return C.vega_pile_length end) then return false end
+
+local size = ffi.new('unsigned int[1]')
+
+-- wrappers of instance methods are factories getting the replaced method and the metatable
+-- of the instances, vega installs them when the methods table of the class is created.
+-- anything but an instance of the class goes to the replaced method, which checks it
+__vega.ffi = {
+    pile = {
+        length = function(length, class) 
+            return function(self) 
+                if getmetatable(self) ~= class then return length(self) end
+                return C.vega_pile_length(self) 
+            end
+        end,
+        
+        find = function(find, class)
+            return function(self, what, start)
+                if type(what) ~= 'string' or getmetatable(self) ~= class then return find(self, what, start) end
+                return C.vega_pile_find(self, what, #what, start or 0)
+            end
+        end,
+        
+        read = function(read, class)
+            return function(self, length)
+                if length ~= nil and type(length) ~= 'number' or getmetatable(self) ~= class then return read(self, length) end
+                
+                size[0] = length or 0
+                local data = C.vega_pile_read(self, size)
+                return ffi.string(data, size[0])
+            end
+        end,
+        
+        write = function(write, class)
+            return function(self, what)
+                if type(what) ~= 'string' or getmetatable(self) ~= class then return write(self, what) end
+                if C.vega_pile_write(self, what, #what) == 0 then error('pile view is read only') end
+            end
+        end
+    },
+    
+    net = {
+        length = function(length, class)
+            return function(self) 
+                if getmetatable(self) ~= class then return length(self) end
+                
+                local result = C.vega_net_length(self)
+                if result < 0 then error('net is closed') end
+                return result
+            end
+        end,
+        
+        id = function(id, class)
+            return function(self) 
+                if getmetatable(self) ~= class then return id(self) end
+                
+                local result = C.vega_net_id(self)
+                if result < 0 then error('net is closed') end
+                return result
+            end
+        end,
+        
+        find = function(find, class)
+            return function(self, what, start)
+                if type(what) ~= 'string' or getmetatable(self) ~= class then return find(self, what, start) end
+                
+                local result = C.vega_net_find(self, what, #what, start or 0)
+                if result < -1 then error('net is closed') end
+                return result
+            end
+        end,
+        
+        send = function(send, class)
+            return function(self, what)
+                if type(what) ~= 'string' or getmetatable(self) ~= class then return send(self, what) end
+                if C.vega_net_send(self, what, #what) == 0 then error('net is closed') end
+            end
+        end
+    }
+}
+
+-- global objects exist before this module is loaded
+__vega.set.random = function(max) 
+    return C.vega_set_random(max or 0) 
+end
+
+return true
@@ -2,6 +2,8 @@ require 'std'
 local common = require 'vega.common'
 
  __vega = __vega or {}
+ 
+require 'vega.ffi'
 
 class = common.class
 
@@ -14,7 +16,16 @@ end
 common.append(__vega.get, wrapper)
 
 run = function(what) 
-    if type(what) == 'function' then return  __vega.jet.start(what) else return __vega.get.runner() end
+    if type(what) == 'function' then return  __vega.jet.start(what) end
+    
+    -- run{fn, line='any'|n} dumps the function with its upvalues and starts it on another line,
+    -- returns the id of the line it was started on
+    if type(what) == 'table' then
+        assert(type(what[1]) == 'function', 'expecting passed function')
+        return __vega.main.spawn(what[1], what.line ~= 'any' and what.line or nil)
+    end
+    
+    return __vega.get.runner()
 end
     
 event = function()
@@ -3,6 +3,14 @@
 
 #include <stdexcept>
 
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#endif
+
  #include "api.h"
 
 
@@ -17,7 +25,24 @@ Vega::Vega( )
     char* threads = getenv( "THREADS" );
     if ( threads )
     {
-        m_threads = atoi( threads );
+        try
+        {
+            m_threads = place( threads );
+        }
+        catch( const std::invalid_argument& e )
+        {
+            fprintf( stderr, "THREADS %s: %s\n", threads, e.what() );
+            ::exit( 1 );
+        }
+    }
+    
+    //
+    //  every line takes a slot in the fixed per line arrays
+    //
+    if ( m_threads > VEGA_LINES_MAX )
+    {
+        fprintf( stderr, "THREADS %s asks for %u lines, at most %d are supported\n", threads, m_threads, VEGA_LINES_MAX );
+        ::exit( 1 );
     }
     
     handler( tau::Line::Started, ( Vega::Handler ) &Vega::lineEvent );
@@ -85,6 +110,160 @@ int Vega::run( )
      s_instance = NULL;
 }
 
+//
+//  THREADS is either a number of floating lines, "auto" for a line pinned to every available core
+//  or a list of cores like "0,2,4-7" with a line pinned to each of them, a single core is
+//  listed as "cores:3" or "3," since "3" alone is a count. listed cores must be online, "auto"
+//  takes at most VEGA_LINES_MAX of them
+//
+unsigned int Vega::place( const std::string& _policy )
+{
+    ENTER();
+    
+    std::string policy = _policy;
+    bool list = policy.find_first_of( ",-" ) != std::string::npos;
+    
+    if ( !policy.compare( 0, 6, "cores:" ) )
+    {
+        policy.erase( 0, 6 );
+        list = true;
+    }
+    
+    if ( policy == "auto" )
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        
+        if ( !sched_getaffinity( 0, sizeof( set ), &set ) )
+        {
+            for ( int i = 0; i < CPU_SETSIZE; i++ )
+            {
+                if ( CPU_ISSET( i, &set ) && m_cores.size() < VEGA_LINES_MAX )
+                {
+                    m_cores.push_back( i );
+                }
+            }
+        }
+#endif
+        if ( m_cores.empty() )
+        {
+            return 1;
+        }
+    }
+    else if ( list )
+    {
+        long cores = std::max( sysconf( _SC_NPROCESSORS_ONLN ), 1L );
+        std::string::size_type start = 0;
+        
+        while ( start < policy.size() )
+        {
+            auto end = policy.find( ',', start );
+            if ( end == std::string::npos )
+            {
+                end = policy.size();
+            }
+            
+            auto range = policy.substr( start, end - start );
+            start = end + 1;
+            
+            if ( range.empty() )
+            {
+                continue;
+            }
+            
+            auto dash = range.find( '-' );
+            int first = core( range.substr( 0, dash ), cores );
+            int last = dash == std::string::npos ? first : core( range.substr( dash + 1 ), cores );
+            
+            if ( last < first )
+            {
+                throw std::invalid_argument( "reversed core range " + range );
+            }
+            
+            for ( int core = first; core <= last; core++ )
+            {
+                m_cores.push_back( core );
+            }
+            
+            if ( m_cores.size() > VEGA_LINES_MAX )
+            {
+                throw std::invalid_argument( "more cores listed than the lines supported" );
+            }
+        }
+    }
+    else
+    {
+        return std::max( atoi( policy.c_str() ), 1 );
+    }
+    
+    return std::max< unsigned int >( m_cores.size(), 1 );
+}
+
+//
+//  a core of the list, a non negative number below the count of online cores
+//
+int Vega::core( const std::string& core, long cores )
+{
+    char* end = NULL;
+    auto number = strtol( core.c_str(), &end, 10 );
+    
+    if ( core.empty() || *end || number < 0 )
+    {
+        throw std::invalid_argument( "invalid core " + core );
+    }
+    
+    if ( number >= cores )
+    {
+        throw std::invalid_argument( "core " + core + " is not online" );
+    }
+    
+    return number;
+}
+
+int Vega::pin( unsigned int slot ) const
+{
+    if ( m_cores.empty() )
+    {
+        return -1;
+    }
+    
+    int core = m_cores[ slot % m_cores.size() ];
+    
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( core, &set );
+    
+    //
+    //  memory of the line is allocated after pinning, so first touch keeps it on the local node
+    //
+    if ( pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) )
+    {
+        ERROR( "could not pin line to core %d", core );
+        return -1;
+    }
+    
+    return core;
+#else
+    return -1;
+#endif
+}
+
+int Vega::node( )
+{
+#if defined( __linux__ ) && defined( SYS_getcpu )
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    
+    if ( !syscall( SYS_getcpu, &cpu, &node, NULL ) )
+    {
+        return node;
+    }
+#endif
+    return -1;
+}
+
 void Vega::error( const lua::Exception& e )
 {
     ERROR( "%s", e.message.c_str() );
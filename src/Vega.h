@@ -47,9 +47,22 @@ public:
     static void error( const lua::Exception& e );
     void cleanup() const;
     
+    //
+    //  pins the calling line to its core, returns the core or -1 if lines are not pinned
+    //
+    int pin( unsigned int slot ) const;
+    static int node( );
+    
+    const std::vector< int >& cores() const
+    {
+        return m_cores;
+    }
+    
 private:
     Vega();
     void lineEvent( tau::Grain& grain ); 
+    unsigned int place( const std::string& policy );
+    static int core( const std::string& core, long cores );
     
 private:
     lua::Script* m_script;
@@ -61,6 +74,7 @@ private:
     tau::si::Lock m_lock;
     int m_status;
     unsigned int m_threads;
+    std::vector< int > m_cores;
 };
 
 #endif	/* _VEGA_H */
@@ -1,22 +1,50 @@
 #include "Vega.h"
 #include "tins.h"
+#include "store.h"
+#include "ffi.h"
+#include "search.h"
+#include "slab.h"
+#include "socket.h"
 
 const Grain::Generators& Api::populate()
 {    
     tau::add( type(), ( Grain::Generator ) &Pile::create, "pile" );
+    tau::add( type(), ( Grain::Generator ) &Loader::create, "loader" );
     
     return *tau::generators( type() );
 }
 
+std::atomic< Mill* > Mill::s_mills[ VEGA_LINES_MAX ];
+std::atomic< unsigned int > Mill::s_count( 0 );
+std::atomic< unsigned int > Mill::s_stopped( 0 );
+
+__thread Mill* t_mill = NULL;
+
 Mill::Mill( Line& line ) 
-: m_lua( Vega::get().script() )
+: m_lua( Vega::get().script() ), m_line( line.id() ), m_pending( 0 ), m_parked( false ), m_stopped( false ), m_wake( [ this ]( ) { tick(); } ), 
+  m_depth( 0 ), m_events( 0 ),
+  m_second( std::chrono::steady_clock::now() )
 {
     ENTER();
     
+    m_slot = s_count++;
+    assert( m_slot < VEGA_LINES_MAX );
+    s_mills[ m_slot ] = this;
+    t_mill = this;
+    Rcu::online( m_slot );
+    Slab::online( m_slot );
+    
+    //
+    //  pin before the lua state is allocated
+    //
+    m_core = Vega::get().pin( m_slot );
+    
     Top::setName( "main" );
 
     Top::method( "start", ( Api::Method ) &Mill::start );
+    Top::method( "spawn", ( Api::Method ) &Mill::spawn );
     Top::method( "reload", ( Api::Method ) &Mill::reload );
+    Top::method( "channel", ( Api::Method ) &Mill::channel );
     
     in::Female::handler( base::Timer::Timeout, ( Mill::Handler ) &Mill::timerEvent );
     in::Female::handler( Line::Stopped, ( Mill::Handler ) &Mill::threadStopEvent );
@@ -28,30 +56,283 @@ Mill::Mill( Line& line )
 #endif
     
     load();
+    schedule( 0 );
 }
 
 Mill::~Mill()
 {
     ENTER();
     
+    s_mills[ m_slot ] = NULL;
+    
+    auto task = m_inbox.take();
+    while ( task )
+    {
+        auto next = task->next;
+        delete task;
+        task = next;
+    }
+    
     for( auto i = m_api.begin(); i != m_api.end(); i++ )
     {
         delete i->second;
     }
 }
 
+Mill* Mill::get( unsigned int line )
+{
+    for ( unsigned int i = 0; i < count(); i++ )
+    {
+        Mill* mill = s_mills[ i ];
+        if ( mill && !mill->m_stopped && mill->line() == line )
+        {
+            return mill;
+        }
+    }
+    
+    return NULL;
+}
+
+Mill& Mill::current( )
+{
+    assert( t_mill );
+    return *t_mill;
+}
+
+Mill* Mill::least( )
+{
+    Mill* least = NULL;
+    
+    for ( unsigned int i = 0; i < count(); i++ )
+    {
+        Mill* mill = s_mills[ i ];
+        if ( mill && !mill->m_stopped && ( !least || mill->weight() < least->weight() ) )
+        {
+            least = mill;
+        }
+    }
+    
+    return least;
+}
+
+std::vector< Mill* > Mill::all( )
+{
+    std::vector< Mill* > mills;
+    
+    for ( unsigned int i = 0; i < count(); i++ )
+    {
+        Mill* mill = s_mills[ i ];
+        if ( mill && !mill->m_stopped )
+        {
+            mills.push_back( mill );
+        }
+    }
+    
+    return mills;
+}
+
+void Mill::post( Task* task )
+{
+    m_pending++;
+    m_inbox.push( task );
+    wake();
+}
+
+void Mill::wake( )
+{
+    if ( m_parked.exchange( false ) )
+    {
+        m_wake.ring();
+    }
+}
+
+void Mill::wake( unsigned int slot )
+{
+    Mill* mill = s_mills[ slot ];
+    if ( mill )
+    {
+        mill->wake();
+    }
+}
+
+void Mill::schedule( unsigned long delay )
+{
+    auto due = Wheel::clock() + delay;
+    if ( !m_ticks.empty() && *m_ticks.begin() <= due )
+    {
+        return;
+    }
+    
+    m_ticks.insert( due );
+    
+    if ( delay )
+    {
+        m_tick = Interval( delay / 1000, delay % 1000 );
+        base::event( this, Tick )( &m_tick );
+    }
+    else
+    {
+        base::event( this, Tick )( );
+    }
+}
+
+void Mill::process( )
+{
+    auto task = m_inbox.take();
+    
+    while ( task )
+    {
+        auto next = task->next;
+        m_pending--;
+        
+        try
+        {
+            ( *task )( *this );
+        }
+        catch ( const lua::Exception& e )
+        {
+            Vega::error( e );
+        }
+        
+        delete task;
+        task = next;
+    }
+}
+
+void Mill::tick( )
+{
+    m_parked = false;
+    
+    if ( !m_inbox.empty() )
+    {
+        process();
+    }
+    
+    Channel::poll();
+    Rcu::quiescent( m_slot );
+    m_wheel.advance( Wheel::clock() );
+    
+    m_stats.loops++;
+    m_stats.timers = m_wheel.size();
+    
+    auto now = std::chrono::steady_clock::now();
+    if ( now - m_second >= std::chrono::seconds( 1 ) )
+    {
+        auto events = m_lua.events();
+        m_stats.rate = events - m_events;
+        m_stats.memory = m_lua.memory();
+        
+        m_events = events;
+        m_second = now;
+    }
+    
+    park();
+}
+
+//
+//  the tick is only scheduled for work the line knows of, otherwise the line 
+//  waits for post or a channel send to wake it
+//
+void Mill::park( )
+{
+    //
+    //  work queued before the flag was set is seen here, later work rings the wake
+    //
+    m_parked = true;
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    
+    //
+    //  retired objects are freed once every line went through its tick, only the lines
+    //  behind the oldest retire are woken and a line still behind ticks again
+    //
+    if ( Rcu::pending() )
+    {
+        for ( unsigned int i = 0; i < count(); i++ )
+        {
+            if ( i != m_slot && Rcu::behind( i ) )
+            {
+                wake( i );
+            }
+        }
+    }
+    
+    if ( !m_inbox.empty() || Channel::ready() || Rcu::behind( m_slot ) )
+    {
+        m_parked = false;
+        schedule( 0 );
+        return;
+    }
+    
+    auto now = Wheel::clock();
+    auto next = m_wheel.next();
+    
+    //
+    //  the event rate is updated once more after the line went idle
+    //
+    if ( m_stats.rate || m_lua.events() != m_events )
+    {
+        unsigned long second = std::chrono::duration_cast< std::chrono::milliseconds >( m_second.time_since_epoch() ).count() + 1000;
+        next = next ? std::min( next, second ) : second;
+    }
+    
+    if ( next )
+    {
+        schedule( next > now ? next - now : 0 );
+    }
+}
+
+void Mill::report( lua::h::Table& table ) const
+{
+    table.set( "line", m_line );
+    table.set( "runners", m_lua.runners() );
+    table.set( "suspended", m_lua.suspended() );
+    table.set( "ready", pending() + m_lua.ready() );
+    table.set( "events", ( unsigned int ) m_stats.rate );
+    table.set( "timers", ( unsigned int ) m_stats.timers );
+    table.set( "memory", ( unsigned int ) m_stats.memory );
+    table.set( "loops", ( unsigned int ) m_stats.loops );
+    table.set( "queued", ( unsigned int ) m_stats.queued );
+    table.set( "dropped", ( unsigned int ) m_stats.dropped );
+}
+
 bool Mill::handle( unsigned int type, tau::Grain& grain )
 {
     tau::in::Female::handle( type, grain );
     
     if ( type == tau::Line::Stopped )
     {
-        delete this;
+        stop();
     }
     
     return true;
 }
 
+//
+//  other lines may still hold the mill from get or least and post to it, so the mills
+//  are only freed by the last line to stop
+//
+void Mill::stop( )
+{
+    ENTER();
+    
+    m_stopped = true;
+    m_wake.close();
+    
+    Channel::clear( m_slot );
+    Rcu::offline( m_slot );
+    Slab::offline( m_slot );
+    
+    if ( ++s_stopped < s_count )
+    {
+        return;
+    }
+    
+    for ( unsigned int i = 0; i < count(); i++ )
+    {
+        delete s_mills[ i ].load();
+    }
+}
+
 void Mill::run()
 {
     ENTER();
@@ -79,6 +360,7 @@ void Mill::load()
     m_lua.set( *this );
     api( new Mall( ) );
     api( new Set( ) );
+    api( new Dictionary( ) );
     
     run( );
 }
@@ -100,13 +382,46 @@ void Mill::Start::operator ()()
     this->runner.deref();
 }
 
-void Mill::timerEvent( tau::Grain& grain )    
+void Mill::Spawn::operator ()( Mill& mill )
 {
     ENTER();
     
+    auto& lua = lua::Main::get();
+    if ( !lua::types::Value::load( pill, lua ) )
+    {
+        throw lua::Exception( "error loading spawned function" );
+    }
+    
+    if ( lua.type( -1 ) != lua::Function )
+    {
+        lua.pop( 1 );
+        throw lua::Exception( "error loading spawned function" );
+    }
+    
+    auto reference = lua.reference();
+    lua.pop( 1 );
+    
+    auto& started = lua.runner();
+    started.setStart( *lua::types::Function::get( reference ) );
+    started.run();
+    
+    lua.unref( reference );
+}
+
+void Mill::timerEvent( tau::Grain& grain )    
+{
     auto& base = dynamic_cast < base::Base& > ( grain );
     
-    if ( base.data() )
+    if ( dynamic_cast< base::Timer& >( grain ).type() == Tick )
+    {
+        if ( !m_ticks.empty() )
+        {
+            m_ticks.erase( m_ticks.begin() );
+        }
+        
+        tick();
+    }
+    else if ( base.data() )
     {
         Start& start = *static_cast < Start* > ( base.data( ) );
         start( );
@@ -132,10 +447,81 @@ void Mill::start( lua::h::Stack& stack )
 {
     ENTER();
     
-    auto timer = base::event( this )();
-    timer->setData( new Start( *this, Top::runner(), stack.reference() ) );
+    auto function = stack.reference();
+    
+    //
+    //  runners started from runners that were just started go through the loop 
+    //  so nested resumes do not grow the stack without bound
+    //
+    if ( m_depth >= MILL_DEPTH_MAX )
+    {
+        auto timer = base::event( this )();
+        timer->setData( new Start( *this, Top::runner(), function ) );
+
+        Top::suspend();
+        return;
+    }
+    
+    auto& started = m_lua.runner();
+    started.setStart( *lua::types::Function::get( function ) );
+    stack.push( Flow::get( started ) );
+    
+    m_depth++;
+    started.run();
+    m_depth--;
+    
+    m_lua.unref( function );
+}
+
+void Mill::spawn( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    if ( stack.type() != lua::Function )
+    {
+        throw lua::Exception( "expecting passed function" );
+    }
+    
+    Pill pill;
+    if ( !stack.dump( pill, lua::types::Visited::Copy, true ) )
+    {
+        throw lua::Exception( "error dumping function" );
+    }
+    
+    Mill* mill = NULL;
+    if ( stack.type() == lua::Number )
+    {
+        unsigned int line = stack.integer();
+        mill = Mill::get( line );
+        
+        if ( !mill )
+        {
+            throw lua::Exception( "line %d not found", line );
+        }
+    }
+    else
+    {
+        mill = Mill::least();
+    }
+    
+    TRACE( "spawning function on line %d", mill->line() );
+    
+    mill->post( new Spawn( pill ) );
+    stack.push( ( int ) mill->line() );
+}
+
+void Mill::channel( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    auto name = stack.string();
+    if ( name.empty() )
+    {
+        throw lua::Exception( "expecting passed channel name" );
+    }
     
-    Top::suspend();
+    auto channel = Channel::get( name );
+    stack.push( *channel );
 }
 
 void Mill::reload( lua::h::Stack& stack )
@@ -190,6 +576,12 @@ bool Mall::onProcess( const std::string& name, lua::h::Stack& stack )
     if ( startable )
     {
         base::Set::Options options = this->options( stack );
+        
+        if ( Socket::enabled( options, "reuseport" ) )
+        {
+            Socket::listen( options );
+        }
+        
         startable->start( options );
         tin->setBase( startable );
     }
@@ -241,9 +633,12 @@ void Set::require( lua::h::Stack& stack )
     }
 }
 
+__thread Set* Set::s_set = NULL;
+
 Set::Set( )
 {
     setName( "set" );
+    s_set = this;
     
     Top::method( "require", ( Api::Method ) &Set::require );
     Top::method( "info", ( Api::Method ) &Set::info );
@@ -252,6 +647,8 @@ Set::Set( )
     Top::method( "dump", ( Api::Method ) &Set::dump );
     Top::method( "load", ( Api::Method ) &Set::load );
     Top::method( "compare", ( Api::Method ) &Set::compare );
+    Top::method( "digest", ( Api::Method ) &Set::digest );
+    Top::method( "declarations", ( Api::Method ) &Set::declarations );
     
     m_random.seed( tau::si::millis() + tau::line().id() );
 }
@@ -259,6 +656,8 @@ Set::Set( )
 Set::~Set()
 {
     ENTER();
+    s_set = NULL;
+    
     for( auto i = m_modules.begin(); i != m_modules.end(); i++ )
     {
         delete *i;
@@ -269,19 +668,25 @@ void Set::dump( lua::h::Stack& stack )
 {
     ENTER();
     
-    auto value = stack.value();
+    Pill pill;
     
-    if ( !value ) 
-   {
+    //
+    //  piles are dumped as strings without making a lua string of them first,
+    //  other values are written straight from the stack
+    //
+    if ( stack.type() == lua::Userdata )
+    {
+        auto chunk = Pile::chunk( stack );
+        auto value = lua::types::String::get( std::string( chunk.data, chunk.length ) );
+        
+        lua::types::Value::dump( pill, *value );
+        value->destroy();
+    }
+    else if ( !stack.dump( pill, shared( stack ) ) )
+    {
         throw lua::Exception( "error dumping object" );
     }
     
-    
-    Pill pill;
-    
-    lua::types::Value::dump( pill, *value );
-    value->destroy();
-    
     TRACE( "pill size %d offset %d", pill.size(), pill.offset() );
 
     stack.push( pill );
@@ -292,26 +697,84 @@ void Set::load( lua::h::Stack& stack )
     ENTER();
 
     Pill data = stack.data();    
-    auto value = lua::types::Value::load( data );
-    if ( value )
+    if ( !stack.load( data ) )
     {
-        stack.push( *value );
-        value->destroy();
+        throw lua::Exception( "error loading object" );
     }
-    else
+}
+
+lua::types::Visited::Shared Set::shared( lua::h::Stack& stack )
+{
+    if ( stack.top() < 2 || lua_type( stack.lua(), -1 ) != LUA_TSTRING )
     {
-        throw lua::Exception( "error loading object" );
+        return lua::types::Visited::Copy;
+    }
+    
+    std::string shared = lua_tostring( stack.lua(), -1 );
+    if ( shared == "once" )
+    {
+        return lua::types::Visited::Once;
+    }
+    
+    if ( shared == "error" )
+    {
+        return lua::types::Visited::Fail;
+    }
+    
+    if ( shared != "copy" )
+    {
+        throw lua::Exception( "unknown shared references policy %s", shared.c_str() );
     }
+    
+    return lua::types::Visited::Copy;
 }
 
+//
+//  values with different digests differ, only equal digests are confirmed by loading both
+//
 void Set::compare( lua::h::Stack& stack )
 {
     ENTER();
     
+    auto index = stack.index();
+    lua::types::Digest left;
+    lua::types::Digest right;
+    
+    bool taken = stack.digest( left );
+    taken = stack.digest( right ) && taken;
+    
+    //
+    //  values without a digest cannot be loaded either
+    //
+    if ( !taken )
+    {
+        throw lua::Exception( "error digesting object" );
+    }
+    
+    if ( left != right )
+    {
+        stack.push( false );
+        return;
+    }
+    
+    stack.setIndex( index );
+    
     std::list< lua::types::Value* > values;
     while ( values.size() < 2 )
     {
-        values.push_back( stack.value() );
+        auto value = stack.value();
+        if ( value )
+        {
+            values.push_back( value );
+            continue;
+        }
+        
+        for ( auto i = values.begin(); i != values.end(); i++ )
+        {
+            ( *i )->destroy();
+        }
+        
+        throw lua::Exception( "error loading object" );
     }
     
     stack.push( *values.front() == *values.back() );
@@ -321,14 +784,120 @@ void Set::compare( lua::h::Stack& stack )
     }
 }
 
+void Set::digest( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    lua::types::Digest digest;
+    if ( !stack.digest( digest ) )
+    {
+        throw lua::Exception( "error digesting object" );
+    }
+    
+    stack.push( digest.tostring() );
+}
 
  void Set::info( lua::h::Stack& stack )
 {
+    //
+    //  load is reported for the requested or the current line
+    //
+    auto& mill = Mill::current();
+    auto loaded = &mill;
+    if ( stack.type() == lua::Number )
+    {
+        unsigned int line = stack.integer();
+        loaded = Mill::get( line );
+        
+        if ( !loaded )
+        {
+            throw lua::Exception( "line %d not found", line );
+        }
+    }
+    
     lua::h::Table table( stack.lua() );
     
+    //
+    //  nested tables have to be on the stack before the parent and are set in reverse order
+    //
+    auto mills = Mill::all();
+    bool pinned = !Vega::get().cores().empty();
+    
+    lua::h::Table lines( stack.lua() );
+    for ( auto i = mills.begin(); i != mills.end(); i++ )
+    {
+        lines.insert( ( *i )->line() );
+    }
+    
+    lua::h::Table cores( stack.lua() );
+    for ( auto i = mills.begin(); pinned && i != mills.end(); i++ )
+    {
+        cores.insert( ( unsigned int ) std::max( ( *i )->core(), 0 ) );
+    }
+    
+    lua::h::Table load( stack.lua() );
+    loaded->report( load );
+    
+    lua::h::Table total( stack.lua() );
+    unsigned int runners = 0, suspended = 0, ready = 0, events = 0, timers = 0, memory = 0, loops = 0, queued = 0, dropped = 0;
+    for ( auto i = mills.begin(); i != mills.end(); i++ )
+    {
+        auto& stats = ( *i )->stats();
+        runners += ( *i )->state().runners();
+        suspended += ( *i )->state().suspended();
+        ready += ( *i )->pending() + ( *i )->state().ready();
+        events += stats.rate;
+        timers += stats.timers;
+        memory += stats.memory;
+        loops += stats.loops;
+        queued = std::max< unsigned int >( queued, stats.queued );
+        dropped += stats.dropped;
+    }
+    
+    total.set( "lines", ( unsigned int ) mills.size() );
+    total.set( "runners", runners );
+    total.set( "suspended", suspended );
+    total.set( "ready", ready );
+    total.set( "events", events );
+    total.set( "timers", timers );
+    total.set( "memory", memory );
+    total.set( "loops", loops );
+    total.set( "queued", queued );
+    total.set( "dropped", dropped );
+    
+    auto slab = Slab::stats();
+    total.setNumber( "buffers", std::max( slab.used, 0L ) );
+    total.setNumber( "cached", std::max( slab.cached, 0L ) );
+    total.set( "prototypes", lua::types::Prototypes::size() );
+    
     table.set( "line", tau::line().id() );
+    table.set( "total", total );
+    table.set( "load", load );
+    
+    if ( pinned )
+    {
+        table.set( "cores", cores );
+    }
+    
+    table.set( "lines", lines );
+    
+    if ( mill.core() >= 0 )
+    {
+        table.set( "core", ( unsigned int ) mill.core() );
+    }
+    
+    auto& collector = lua::Main::get().collector();
+    table.set( "gc", ( unsigned int ) ( collector.time / 1000 ) );
+    table.set( "gccycles", ( unsigned int ) collector.cycles );
+    
+    auto node = Vega::node();
+    if ( node >= 0 )
+    {
+        table.set( "node", ( unsigned int ) node );
+    }
     table.set( "pid", si::Process::id() );
     table.set( "version", Vega::get().version() );
+    table.set( "search", Search::engine() );
     
     stack.push( table );
 }
@@ -340,6 +909,84 @@ void Set::random( lua::h::Stack& stack )
     stack.push( value ); 
 }
 
+unsigned int Set::random( unsigned int max )
+{
+    assert( s_set );
+    auto& random = s_set->m_random;
+    return max ? random() % max : random();
+}
+
+void Set::declarations( lua::h::Stack& stack )
+{
+    stack.push( Ffi::declarations() );
+}
+
+
+Dictionary::Dictionary( )
+{
+    setName( "dictionary" );
+    
+    Top::method( "set", ( Api::Method ) &Dictionary::set );
+    Top::method( "get", ( Api::Method ) &Dictionary::get );
+    Top::method( "remove", ( Api::Method ) &Dictionary::remove );
+    Top::method( "keys", ( Api::Method ) &Dictionary::keys );
+}
+
+void Dictionary::set( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    auto key = stack.string();
+    auto data = stack.data();
+    
+    auto value = std::make_shared< Pill >();
+    value->add( data.data(), data.length() );
+    
+    Store::instance().set( key, value );
+    
+    if ( Rcu::pending() )
+    {
+        Mill::current().schedule( 0 );
+    }
+}
+
+void Dictionary::get( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    auto key = stack.string();
+    Store::instance().get( key, [ & ]( const Pill& value ) { stack.push( value ); } );
+}
+
+void Dictionary::remove( lua::h::Stack& stack )
+{
+    ENTER();
+    Store::instance().remove( stack.string() );
+    
+    if ( Rcu::pending() )
+    {
+        Mill::current().schedule( 0 );
+    }
+}
+
+void Dictionary::keys( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    auto keys = Store::instance().keys();
+    if ( keys.empty() )
+    {
+        return;
+    }
+    
+    lua::h::Table table( stack.lua() );
+    for ( auto i = keys.begin(); i != keys.end(); i++ )
+    {
+        table.insert( *i );
+    }
+    
+    stack.push( table );
+}
 
 Pile* Pile::get( Pill* pill )
 {
@@ -357,21 +1004,181 @@ Rock* Pile::create( )
 }
 
 Pile::Pile()
-: m_used( NULL )
+: m_used( NULL ), m_consumed( 0 ), m_kept( 0 ), m_source( NULL ), m_start( 0 ), m_end( 0 ), m_views( 0 ), m_collected( false )
 {
     ENTER();
     Api::method( "read", ( Api::Method ) &Pile::read );
     Api::method( "write", ( Api::Method ) &Pile::write );
     Api::method( "find", ( Api::Method ) &Pile::find );
     Api::method( "length", ( Api::Method ) &Pile::length );
+    Api::method( "slice", ( Api::Method ) &Pile::slice );
+    Api::method( "view", ( Api::Method ) &Pile::view );
     
 }
 
 void Pile::cleanup()
 {
     ENTER();
+    
+    if ( m_source )
+    {
+        m_source->release();
+        m_source = NULL;
+    }
+    
     m_used = NULL;
     m_pill.clear();
+    m_consumed = m_kept = 0;
+    m_start = m_end = 0;
+    m_collected = false;
+}
+
+//
+//  a pile with views is given back only after the last view is collected
+//
+void Pile::gc()
+{
+    ENTER();
+    m_collected = true;
+    
+    if ( !m_views )
+    {
+        tau::reuse( *this );
+    }
+}
+
+//
+//  bytes read from the source while it had views are dropped with the last view
+//
+void Pile::release()
+{
+    assert( m_views );
+    
+    if ( --m_views )
+    {
+        return;
+    }
+    
+    used().read( m_kept );
+    m_kept = 0;
+    
+    if ( m_collected )
+    {
+        tau::reuse( *this );
+    }
+}
+
+unsigned long Pile::begin() const
+{
+    if ( !m_source )
+    {
+        return m_consumed;
+    }
+    
+    return m_start;
+}
+
+unsigned long Pile::end() const
+{
+    if ( !m_source )
+    {
+        return front() + used().length();
+    }
+    
+    return m_end;
+}
+
+const char* Pile::data() const
+{
+    if ( !m_source )
+    {
+        return used().contents() + m_kept;
+    }
+    
+    return m_source->used().contents() + ( m_start - m_source->front() );
+}
+
+int Pile::find( const char* data, unsigned int length, unsigned int start ) const
+{
+    return Search::find( this->data(), this->length(), data, length, start );
+}
+
+const char* Pile::read( unsigned int& length )
+{
+    if ( !length || length > this->length() )
+    {
+        length = this->length();
+    }
+    
+    //
+    //  the bytes of views stay in the pill of the source until the views are gone
+    //
+    if ( m_source || m_views )
+    {
+        auto data = this->data();
+        
+        if ( m_source )
+        {
+            m_start += length;
+        }
+        else
+        {
+            m_consumed += length;
+            m_kept += length;
+        }
+        
+        return data;
+    }
+    
+    m_consumed += length;
+    return used().read( length );
+}
+
+bool Pile::write( const char* data, unsigned int length )
+{
+    if ( m_source )
+    {
+        return false;
+    }
+    
+    used().add( data, length );
+    return true;
+}
+
+Pile* Pile::view( unsigned int offset, unsigned int length )
+{
+    auto source = m_source ? m_source : this;
+    auto view = Pile::get();
+    
+    view->m_source = source;
+    view->m_start = begin() + std::min( offset, this->length() );
+    view->m_end = view->m_start + std::min< unsigned long >( length, end() - view->m_start );
+    
+    source->m_views++;
+    return view;
+}
+
+Pile::Chunk Pile::chunk( lua::h::Stack& stack )
+{
+    Chunk chunk = { NULL, 0 };
+    
+    if ( stack.type() == lua::Userdata )
+    {
+        auto pile = dynamic_cast< Pile* >( stack.object() );
+        if ( !pile )
+        {
+            throw lua::Exception( "expecting passed pile" );
+        }
+        
+        chunk.data = pile->data();
+        chunk.length = pile->length();
+    }
+    else
+    {
+        chunk.data = stack.bytes( chunk.length );
+    }
+    
+    return chunk;
 }
 
 void Pile::read( lua::h::Stack& stack )
@@ -392,32 +1199,124 @@ void Pile::read( lua::h::Stack& stack )
         }
     }
     
-    if ( !length )
-    {
-        length = used().length();
-    }
-    
-    const char* data = used().read( length );
+    const char* data = read( length );
     stack.push( data, length );
 }
 
 void Pile::write( lua::h::Stack& stack )
 {
     ENTER();
-    used().add( stack.data() );
+    
+    auto chunk = Pile::chunk( stack );
+    if ( !write( chunk.data, chunk.length ) )
+    {
+        throw lua::Exception( "pile view is read only" );
+    }
 }
 
 void Pile::length( lua::h::Stack& stack )
 {
     ENTER();
-    stack.push( ( int ) used().length() );
+    stack.push( ( int ) length() );
 }
 
 void Pile::find( lua::h::Stack& stack )
 {
     ENTER();
-    stack.push( used().find( stack.data() ) );
+    
+    auto chunk = Pile::chunk( stack );
+    unsigned int start = 0;
+    
+    if ( stack.type() == lua::Number )
+    {
+        start = stack.integer();
+    }
+    
+    stack.push( find( chunk.data, chunk.length, start ) );
 }
 
+void Pile::slice( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    int offset = 0;
+    int length = this->length();
+    
+    if ( stack.type() == lua::Number )
+    {
+        offset = stack.integer();
+    }
+    
+    if ( stack.type() == lua::Number )
+    {
+        length = stack.integer();
+    }
+    
+    if ( offset < 0 || length < 0 )
+    {
+        throw lua::Exception( "expecting positive offset and length" );
+    }
+    
+    stack.push( *view( offset, length ) );
+}
+
+void Pile::view( lua::h::Stack& stack )
+{
+    ENTER();
+    stack.push( *view( 0, length() ) );
+}
 
+Api* Loader::create( )
+{
+    return new Loader();
+}
 
+Loader::Loader()
+{
+    ENTER();
+    Api::method( "write", ( Api::Method ) &Loader::write );
+    Api::method( "read", ( Api::Method ) &Loader::read );
+    Api::method( "length", ( Api::Method ) &Loader::length );
+}
+
+//
+//  a malformed dump drops what was decoded so far, the next write starts a new dump
+//
+void Loader::write( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    auto chunk = Pile::chunk( stack );
+    if ( !m_stream.write( chunk.data, chunk.length ) )
+    {
+        m_stream.clear();
+        throw lua::Exception( "error loading object" );
+    }
+}
+
+void Loader::read( lua::h::Stack& stack )
+{
+    ENTER();
+    
+    lua::types::Value* value = NULL;
+    if ( !m_stream.read( value ) )
+    {
+        return;
+    }
+    
+    if ( value )
+    {
+        stack.push( *value );
+        value->destroy();
+    }
+    else
+    {
+        lua_pushnil( stack.lua() );
+    }
+}
+
+void Loader::length( lua::h::Stack& stack )
+{
+    ENTER();
+    stack.push( ( int ) m_stream.size() );
+}
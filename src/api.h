@@ -2,6 +2,11 @@
 #define	API_H
 
 #include "Vega.h"
+#include "queue.h"
+#include "wheel.h"
+#include "wake.h"
+
+#include <set>
 
 using namespace tau;
 
@@ -49,12 +54,138 @@ public:
     Mill( tau::Line& line );
     virtual ~Mill();
     
+    //
+    //  work handed over to the line from other lines
+    //
+    struct Task
+    {
+        Task* next;
+        
+        Task( )
+        : next( NULL )
+        {
+        }
+        
+        virtual ~Task( )
+        {
+        }
+        
+        virtual void operator()( Mill& mill ) = 0;
+    };
+    
+    static Mill* get( unsigned int line );
+    static Mill& current( );
+    static Mill* least( );
+    static std::vector< Mill* > all( );
+    
+    static unsigned int count( )
+    {
+        return std::min< unsigned int >( s_count, VEGA_LINES_MAX );
+    }
+    
+    unsigned int line( ) const
+    {
+        return m_line;
+    }
+    
+    //
+    //  dense index of the line in [0, VEGA_LINES_MAX)
+    //
+    unsigned int slot( ) const
+    {
+        return m_slot;
+    }
+    
+    //
+    //  core the line is pinned to or -1
+    //
+    int core( ) const
+    {
+        return m_core;
+    }
+    
+    //
+    //  live runners plus spawned functions not started yet
+    //
+    unsigned int weight( ) const
+    {
+        return m_lua.runners() + m_pending;
+    }
+    
+    //
+    //  spawned functions not started yet
+    //
+    unsigned int pending( ) const
+    {
+        return m_pending;
+    }
+    
+    const lua::Main& state( ) const
+    {
+        return m_lua;
+    }
+    
+    void post( Task* task );
+    
+    //
+    //  runs the tick of a parked line, can be called from any line
+    //
+    void wake( );
+    static void wake( unsigned int slot );
+    
+    //
+    //  runs the tick in delay milliseconds unless it runs earlier already
+    //
+    void schedule( unsigned long delay );
+    
+    //
+    //  load of the line, updated by the line and read by any
+    //
+    struct Stats
+    {
+        std::atomic< unsigned int > timers;
+        std::atomic< unsigned int > memory;
+        std::atomic< unsigned int > rate;
+        std::atomic< unsigned long > loops;
+        
+        //
+        //  high-water mark of the per-call event queues and events dropped by full queues
+        //
+        std::atomic< unsigned int > queued;
+        std::atomic< unsigned long > dropped;
+        
+        Stats( )
+        : timers( 0 ), memory( 0 ), rate( 0 ), loops( 0 ), queued( 0 ), dropped( 0 )
+        {
+        }
+    };
+    
+    Stats& stats( )
+    {
+        return m_stats;
+    }
+    
+    Wheel& wheel( )
+    {
+        return m_wheel;
+    }
+    
+    void report( lua::h::Table& table ) const;
+    
 private:
     void load();   
 
     void start( lua::h::Stack& stack );    
+    void spawn( lua::h::Stack& stack );    
     void reload( lua::h::Stack& stack );    
     
+    void tick( );
+    void park( );
+    void process( );
+    void stop( );
+    
+    void channel( lua::h::Stack& stack );    
+    
     void timerEvent( tau::Grain& grain );
     void threadStopEvent( tau::Grain& grain );
     virtual bool handle( unsigned int type, tau::Grain& grains );
@@ -94,6 +225,25 @@ private:
         void operator()();
     };
     
+    struct Spawn: public Task
+    {
+        Pill pill;
+        
+        Spawn( const Pill& _pill )
+        : pill( _pill )
+        {
+        }
+        
+        virtual void operator()( Mill& mill );
+    };
+    
+    enum Type
+    {
+        Tick = 1
+    };
+    
+#define MILL_DEPTH_MAX 32
+    
     virtual unsigned int index( ) const
     {
         return typeid ( this ).hash_code( );
@@ -106,6 +256,29 @@ private:
 private:
     lua::Main m_lua;
     Top::Map m_api;
+    unsigned int m_line;
+    unsigned int m_slot;
+    int m_core;
+    Inbox< Task > m_inbox;
+    std::atomic< unsigned int > m_pending;
+    
+    //
+    //  set while the line waits for a wake with no tick scheduled, and due times of the scheduled ticks
+    //
+    std::atomic< bool > m_parked;
+    std::atomic< bool > m_stopped;
+    Wake m_wake;
+    Interval m_tick;
+    std::multiset< unsigned long > m_ticks;
+    unsigned int m_depth;
+    Stats m_stats;
+    Wheel m_wheel;
+    unsigned long m_events;
+    std::chrono::steady_clock::time_point m_second;
+    
+    static std::atomic< Mill* > s_mills[ VEGA_LINES_MAX ];
+    static std::atomic< unsigned int > s_count;
+    static std::atomic< unsigned int > s_stopped;
 };
 
 class Mall: public Top
@@ -136,13 +309,25 @@ public:
     Set( );
     virtual ~Set();
     
+    //
+    //  random number from the generator of the current line
+    //
+    static unsigned int random( unsigned int max );
+    
 private:
     void require( lua::h::Stack& stack );
     void info( lua::h::Stack& stack );
     void random( lua::h::Stack& stack );
+    void declarations( lua::h::Stack& stack );
     void dump( lua::h::Stack& stack );
     void load( lua::h::Stack& stack );
     void compare( lua::h::Stack& stack );
+    void digest( lua::h::Stack& stack );
+    
+    //
+    //  policy for shared references passed after the dumped object
+    //
+    static lua::types::Visited::Shared shared( lua::h::Stack& stack );
     
     virtual unsigned int index( ) const
     {
@@ -154,6 +339,29 @@ private:
 private:
     std::default_random_engine m_random;
     ModuleList m_modules;
+    
+    static __thread Set* s_set;
+};
+
+class Dictionary: public Top
+{
+public:
+    Dictionary( );
+    virtual ~Dictionary()
+    {
+        ENTER();
+    }
+    
+private:
+    void set( lua::h::Stack& stack );
+    void get( lua::h::Stack& stack );
+    void remove( lua::h::Stack& stack );
+    void keys( lua::h::Stack& stack );
+    
+    virtual unsigned int index( ) const
+    {
+        return typeid ( this ).hash_code( );
+    }
 };
 
 class Pile: public Rock, public Api
@@ -173,14 +381,47 @@ public:
         return used();
     }
     
-private:
-    Pile();
-    virtual void gc()
+    //
+    //  bytes of a string or of a pile passed at the stack, piles are not copied
+    //
+    struct Chunk
     {
-        ENTER();
-        tau::reuse( *this );
+        const char* data;
+        unsigned int length;
+    };
+    
+    static Chunk chunk( lua::h::Stack& stack );
+    
+    const char* data() const;
+    unsigned int length() const
+    {
+        return end() - begin();
     }
     
+    //
+    //  position of the bytes in the readable ones at or after start or -1
+    //
+    int find( const char* data, unsigned int length, unsigned int start = 0 ) const;
+    
+    //
+    //  consumes length bytes, all the readable ones if length is 0
+    //
+    const char* read( unsigned int& length );
+    
+    //
+    //  views are read only
+    //
+    bool write( const char* data, unsigned int length );
+    
+    //
+    //  pile sharing the storage of this one, limited to length bytes from offset
+    //
+    Pile* view( unsigned int offset, unsigned int length );
+    
+private:
+    Pile();
+    virtual void gc();
+    
     void setUsed( Pill* pill )
     {
         m_used = pill ? pill : &m_pill;
@@ -190,6 +431,13 @@ private:
     void read( lua::h::Stack& );
     void write( lua::h::Stack& );
     void length( lua::h::Stack& );
+    void slice( lua::h::Stack& );
+    void view( lua::h::Stack& );
+    
+    virtual const char* exports( ) const
+    {
+        return "pile";
+    }
     
     Pill& used() const
     {
@@ -197,6 +445,22 @@ private:
         return *m_used;
     }
     
+    //
+    //  positions in the stream of the pile, a view covers part of the stream of its source
+    //
+    unsigned long begin() const;
+    unsigned long end() const;
+    
+    //
+    //  position of the first byte still in the pill, bytes read while there are views are kept
+    //
+    unsigned long front() const
+    {
+        return m_consumed - m_kept;
+    }
+    
+    void release();
+    
     virtual unsigned int index() const
     {
         return typeid( *this ).hash_code();
@@ -205,11 +469,50 @@ private:
 private:
     Pill m_pill;
     Pill* m_used;   
+    unsigned long m_consumed;
+    unsigned long m_kept;
+    
+    Pile* m_source;
+    unsigned long m_start;
+    unsigned long m_end;
+    unsigned int m_views;
+    bool m_collected;
 };
 
+//
+//  decoder of dumps arriving in pieces, values can be read as soon as their last byte is written
+//
+class Loader: public Api
+{
+public:
+    static Api* create( );
+    
+    virtual ~Loader()
+    {
+    }
+    
+private:
+    Loader();
+    
+    void write( lua::h::Stack& );
+    void read( lua::h::Stack& );
+    void length( lua::h::Stack& );
+    
+    virtual const char* exports( ) const
+    {
+        return "loader";
+    }
+    
+    virtual unsigned int index() const
+    {
+        return typeid( *this ).hash_code();
+    }
+    
+private:
+    lua::types::Stream m_stream;
+};
 
 
 
-#endif	
 
-    
\ No newline at end of file
+#endif	
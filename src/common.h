@@ -8,12 +8,15 @@
 
 #include <string>
 #include <list>
+#include <deque>
 #include <map>
 #include <unordered_map>
 #include <vector>
 #include <exception> 
 #include <stdexcept>  
 #include <random>
+#include <atomic>
+#include <chrono>
 
 #include "trace.h"
 
@@ -25,6 +28,8 @@
 
 #define VEGA_NAME "vega"
 
+#define VEGA_LINES_MAX 256
+
 
 
 #endif 
@@ -0,0 +1,91 @@
+#include "ffi.h"
+#include "tins.h"
+
+#define VEGA_FFI_STRING( result, name, arguments ) #result " " #name #arguments ";\n"
+
+std::string Ffi::declarations( )
+{
+    return VEGA_FFI( VEGA_FFI_STRING );
+}
+
+//
+//  the lua wrappers only pass userdata with the metatable of the class
+//
+template< class Type > static Type* instance( void* data )
+{
+    return data ? dynamic_cast< Type* >( lua::Object::get( *( void** ) data ) ) : NULL;
+}
+
+unsigned int vega_pile_length( void* data )
+{
+    auto pile = instance< Pile >( data );
+    return pile ? pile->length() : 0;
+}
+
+int vega_pile_find( void* data, const char* what, unsigned int length, unsigned int start )
+{
+    auto pile = instance< Pile >( data );
+    return pile ? pile->find( what, length, start ) : -1;
+}
+
+const char* vega_pile_read( void* data, unsigned int* length )
+{
+    auto pile = instance< Pile >( data );
+    if ( !pile )
+    {
+        *length = 0;
+        return NULL;
+    }
+    
+    return pile->read( *length );
+}
+
+int vega_pile_write( void* data, const char* what, unsigned int length )
+{
+    auto pile = instance< Pile >( data );
+    return pile && pile->write( what, length );
+}
+
+//
+//  a closed net has no base to read from
+//
+static Net* open( void* data )
+{
+    auto net = instance< Net >( data );
+    return net && !net->closed() ? net : NULL;
+}
+
+int vega_net_length( void* data )
+{
+    auto net = open( data );
+    return net ? ( int ) net->length() : -1;
+}
+
+int vega_net_id( void* data )
+{
+    auto net = open( data );
+    return net ? net->fd() : -1;
+}
+
+int vega_net_find( void* data, const char* what, unsigned int length, unsigned int start )
+{
+    auto net = open( data );
+    return net ? net->find( what, length, start ) : -2;
+}
+
+int vega_net_send( void* data, const char* what, unsigned int length )
+{
+    auto net = open( data );
+    if ( !net )
+    {
+        return 0;
+    }
+    
+    net->send( what, length );
+    return 1;
+}
+
+unsigned int vega_set_random( unsigned int max )
+{
+    return Set::random( max );
+}
@@ -0,0 +1,38 @@
+#ifndef VEGA_FFI_H
+#define	VEGA_FFI_H
+
+#include "common.h"
+
+//
+//  api methods exported as plain functions, lua wrappers call them through the luajit ffi
+//  so loops using them stay jit compiled, instances are passed as the objects userdata
+//  and net functions return -1, -2 for find, or 0 for send on a closed net
+//
+#define VEGA_FFI( EXPORT ) \
+    EXPORT( unsigned int, vega_pile_length, ( void* pile ) ) \
+    EXPORT( int, vega_pile_find, ( void* pile, const char* data, unsigned int length, unsigned int start ) ) \
+    EXPORT( const char*, vega_pile_read, ( void* pile, unsigned int* length ) ) \
+    EXPORT( int, vega_pile_write, ( void* pile, const char* data, unsigned int length ) ) \
+    EXPORT( int, vega_net_length, ( void* net ) ) \
+    EXPORT( int, vega_net_id, ( void* net ) ) \
+    EXPORT( int, vega_net_find, ( void* net, const char* data, unsigned int length, unsigned int start ) ) \
+    EXPORT( int, vega_net_send, ( void* net, const char* data, unsigned int length ) ) \
+    EXPORT( unsigned int, vega_set_random, ( unsigned int max ) )
+
+#define VEGA_FFI_DECLARE( result, name, arguments ) result name arguments;
+
+extern "C"
+{
+    VEGA_FFI( VEGA_FFI_DECLARE )
+}
+
+class Ffi
+{
+public:
+    //
+    //  declarations of the exported functions for ffi.cdef
+    //
+    static std::string declarations( );
+};
+
+#endif
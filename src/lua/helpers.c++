@@ -6,17 +6,6 @@ namespace lua
 {
     namespace h   
     {
-        void Data::operator()( lua_CFunction gc, void* data )
-        {
-            Lua::dec();
-            Table table( m_lua );
-            Arguments upvalues;
-            upvalues.add( data );
-            table.set( "__gc", gc, upvalues );
-            
-            m_lua.setmetatable( Lua::index() );
-        }
-        
         Table::Table( Stack& stack, int index )
         : Lua( stack.lua( ) )
         {
@@ -168,6 +157,16 @@ namespace lua
         }
 
         void Table::insert( const std::string& value, int index )
+        {
+            insert( [ & ]( ) { m_lua.push( value ); }, index );
+        }
+        
+        void Table::insert( unsigned int value, int index )
+        {
+            insert( [ & ]( ) { m_lua.push( ( int ) value ); }, index );
+        }
+        
+        template < class Push > void Table::insert( Push push, int index )
         {
             create( );
 
@@ -178,7 +177,7 @@ namespace lua
                 inc = true;
             }
             m_lua.push( ( int ) index );
-            m_lua.push( value );
+            push( );
             
             m_lua.settable( -3 );
 
@@ -233,6 +232,13 @@ namespace lua
                 m_lua.push( ( int ) value );
             } );            
         }
+        
+        void Table::setNumber( const std::string& name, long value )
+        {
+            setfield( name, [ & ]( ) {
+                m_lua.push( value );
+            } );
+        }
 
         void Table::setmetatable( Table& table )
         {
@@ -267,6 +273,13 @@ namespace lua
             return result;
         }
 
+        Object* Stack::object( )
+        {
+            Object* result = NULL;
+            get( [ & ]( ){ result = Object::get( m_lua.toinstance( index() ) ); } );
+            return result;
+        }
+        
         int Stack::integer( )
         {
             int result = 0;
@@ -306,18 +319,59 @@ namespace lua
             return result;
         }
 
+        const char* Stack::bytes( unsigned int& length )
+        {
+            const char* result = NULL;
+            size_t size = 0;
+            
+            get( [ & ]( )
+            { 
+                if ( m_lua.type( index() ) == String )
+                {
+                    result = lua_tolstring( m_lua, index(), &size ); 
+                }
+            } );
+            
+            length = size;
+            return result;
+        }
+        
         std::string Stack::string( )
         {
             std::string result;
             get( [ & ]( ){ result = m_lua.tostring( index(), true ); } );
             return result;
         }
-        types::Value* Stack::value( )
+        types::Value* Stack::value( types::Visited::Shared shared )
         {
-            types::Value* value = types::Value::load( m_lua, index( ), false );
+            types::Value* value = types::Value::load( m_lua, index( ), false, shared );
             inc( );
             return value;
         }
+        
+        bool Stack::dump( tau::Pill& pill, types::Visited::Shared shared, bool cached )
+        {
+            bool dumped = types::Value::dump( pill, m_lua, index( ), shared, cached );
+            inc( );
+            return dumped;
+        }
+        
+        bool Stack::digest( types::Digest& digest )
+        {
+            bool taken = types::Digest::take( m_lua, index( ), digest );
+            inc( );
+            return taken;
+        }
+        
+        bool Stack::load( tau::Pill& pill )
+        {
+            bool loaded = false;
+            pushvalue( [ & ]( ) {
+                loaded = types::Value::load( pill, m_lua );
+            } );
+            
+            return loaded;
+        }
         unsigned int Stack::reference( )
         {
             unsigned int result = m_lua.reference( index() );
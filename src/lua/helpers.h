@@ -2,6 +2,7 @@
 #define	HELPERS_H
 
 #include "state.h"
+#include "types.h"
 
 namespace lua
 {
@@ -90,18 +91,6 @@ namespace lua
             unsigned int m_count;
         };
         
-        class Data: public Lua
-        {
-        public:
-            Data( const State& lua )
-            : Lua( lua )
-            {
-                lua.userdata();
-            }
-            
-            void operator()( lua_CFunction gc, void* data );
-        };
-
         class Stack;
         
         class Table : public Lua
@@ -130,9 +119,11 @@ namespace lua
             void set( const std::string& name, void* value );
             void set( const std::string& name, Table& table );
             void set( const std::string& name, unsigned int value );
+            void setNumber( const std::string& name, long value );
             void setReference( const std::string& name, unsigned int ref );
 
             void insert( const std::string& value, int index = 0 );
+            void insert( unsigned int value, int index = 0 );
 
             unsigned int reference() const
             {
@@ -170,6 +161,7 @@ namespace lua
             bool is( ) const;
             
             template < class Set > void setfield( const std::string name, Set set );
+            template < class Push > void insert( Push push, int index );
             template < class Field > void field( const std::string& name, Field field, bool pop = true );
 
         private:
@@ -199,11 +191,29 @@ namespace lua
             long number( );
             Table table( );
             void* pointer( );
+            Object* object( );
             int integer( );
             tau::Pill data();
+            
+            //
+            //  bytes of a string argument without copying them
+            //
+            const char* bytes( unsigned int& length );
             std::string string( );
             bool boolean( );
-            types::Value* value( );
+            types::Value* value( types::Visited::Shared shared = types::Visited::Copy );
+            
+            //
+            //  dumps the value at the index or pushes a dumped one, without loading values,
+            //  cached dumps refer to function code by key and are only for this process
+            //
+            bool dump( tau::Pill& pill, types::Visited::Shared shared = types::Visited::Copy, bool cached = false );
+            bool load( tau::Pill& pill );
+            
+            //
+            //  false if the value at the index has no digest
+            //
+            bool digest( types::Digest& digest );
             unsigned int reference( );
 
             void setTop( unsigned int top )
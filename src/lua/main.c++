@@ -1,5 +1,7 @@
 #include "main.h"
 
+#include <chrono>
+
 namespace lua
 {
     std::string Main::s_global = "__vega";
@@ -13,6 +15,52 @@ namespace lua
         t_main = this;
         m_lua = State::create();
         types::Value::populate();
+        
+        lua_gc( m_lua, LUA_GCSETPAUSE, m_collector.pause );
+        lua_gc( m_lua, LUA_GCSETSTEPMUL, m_collector.stepmul );
+        
+        while ( m_threads.size() < MAIN_THREADS_MIN )
+        {
+            m_threads.push_back( create() );
+        }
+    }
+    
+    Main::Thread Main::create() const
+    {
+        Thread thread( lua_newthread( m_lua ) );
+        thread.reference = reference( );
+        pop( 1 );
+        
+        return thread;
+    }
+    
+    Main::Thread Main::thread()
+    {
+        if ( m_threads.empty() )
+        {
+            return create();
+        }
+        
+        auto thread = m_threads.back();
+        m_threads.pop_back();
+        return thread;
+    }
+    
+    void Main::release( const Thread& thread, bool finished )
+    {
+        //
+        //  only threads whose body returned from lua_resume can be resumed with a new function,
+        //  a thread stopped while it runs, yields or resumes another is left to the collector
+        //
+        if ( m_lua && finished && lua_status( thread.lua ) == 0 && m_threads.size() < MAIN_THREADS_MAX )
+        {
+            lua_settop( thread.lua, 0 );
+            m_threads.push_back( thread );
+        }
+        else if ( m_lua )
+        {
+            unref( thread.reference );
+        }
     }
     
     Main& Main::get()
@@ -21,10 +69,65 @@ namespace lua
         return *t_main;
     }
     
+    static unsigned int option( const char* name, unsigned int value )
+    {
+        auto option = getenv( name );
+        return option ? atoi( option ) : value;
+    }
+    
+    Main::Collector::Collector( )
+    : pause( option( "GC_PAUSE", 200 ) ), stepmul( option( "GC_STEPMUL", 200 ) ), budget( option( "GC_BUDGET", 500 ) ), 
+      step( option( "GC_STEP", 16 ) ), time( 0 ), cycles( 0 )
+    {
+    }
+    
     void Main::gc()
     {
-        ENTER();
-        tau::base::event( this )();
+        if ( !m_garbage )
+        {
+            m_garbage = true;
+            tau::base::event( this, Collect )();
+        }
+    }
+    
+    void Main::collect()
+    {
+        if ( !m_lua )
+        {
+            m_garbage = false;
+            return;
+        }
+        
+        if ( !m_garbage )
+        {
+            return;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        auto budget = std::chrono::microseconds( m_collector.budget );
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        
+        do
+        {
+            //
+            //  LUA_GCSTEP returns 1 when the step finished a cycle
+            //
+            if ( lua_gc( m_lua, LUA_GCSTEP, m_collector.step ) )
+            {
+                m_garbage = false;
+                m_collector.cycles++;
+            }
+            
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        while ( m_garbage && elapsed < budget );
+        
+        m_collector.time += std::chrono::duration_cast< std::chrono::microseconds >( elapsed ).count();
+        
+        if ( m_garbage )
+        {
+            tau::base::event( this, Collect )();
+        }
     }
 
     void Main::close( )
@@ -36,6 +139,11 @@ namespace lua
         }
         
         stop();
+        
+        while ( auto runner = dequeue() )
+        {
+            runner->deref();
+        }
 
         for ( auto i = m_routers.begin( ); i != m_routers.end( ); i++ )
         {
@@ -43,6 +151,7 @@ namespace lua
         }
         
         m_routers.clear( );
+        m_threads.clear( );
         
         lua_close( m_lua );
         m_lua = NULL;
@@ -78,55 +187,78 @@ namespace lua
         va_end( next );
     }
     Main::Main( const Script& script )
-    : m_script( script ), m_success( true ), m_init( false )
+    : m_script( script ), m_success( true ), m_init( false ), m_runners( 0 ), m_suspended( 0 ), m_events( 0 ), m_garbage( false ),
+      m_head( NULL ), m_tail( NULL ), m_ready( 0 ), m_batch( option( "READY_BATCH", 256 ) ), m_scheduled( false )
     {
         tau::in::Female::handler( Runner::Stop, ( Main::Handler ) & Main::runnerStopped );
-        tau::in::Female::handler( tau::base::Timer::Timeout, ( Main::Handler ) & Main::timer );
+        tau::in::Female::handler( tau::base::Timer::Timeout, ( Main::Handler ) & Main::resume );
     }
     
-    void Main::Index::operator ()( h::Table& table )
+    Main::Router& Main::Index::router()
     {
-        ENTER();
-        
         auto hash = object.index();
         
-        Router* router = NULL;
-        
         auto found = routers.find( hash );
-        if ( found == routers.end( ) )
-        {
-            router = new Router( object );
-            routers[ hash ] = router;
-        }
-        else
+        if ( found != routers.end( ) )
         {
-            router = found->second;
+            return *found->second;
         }
         
-        object.onIndex( *router, table );
+        auto router = new Router( object );
+        routers[ hash ] = router;
+        
+        return *router;
+    }
+    
+    void Main::Index::operator ()( h::Table& table )
+    {
+        ENTER();
         
         h::Table index( table.lua() );
-        index.setReference( "__index", router->reference() );
+        index.setReference( "__index", router().reference() );
         
         table.setmetatable( index );
     }
     
+    //
+    //  self stays below the arguments, the metatable of the class is the second upvalue
+    //  and instances carrying fields have their own one, found by the mark
+    //
     void* Main::Router::Dispatch::instance( h::Stack& stack )
     {
+        if ( !stack.top( ) )
+        {
+            return NULL;
+        }
+        
+        lua_State* lua = runner();
+        auto index = -( int ) stack.top( );
         void* data = NULL;
-        h::Table table = stack.table( );
-
-        if ( stack.top( ) )
+        
+        if ( lua_type( lua, index ) != LUA_TUSERDATA )
         {
-            table.setIndex( -stack.top( ) );
-            data = table.data( "__instance" );
-
-            if ( data )
+            return NULL;
+        }
+        
+        if ( lua_getmetatable( lua, index ) )
+        {
+            if ( lua_rawequal( lua, -1, lua_upvalueindex( 2 ) ) )
             {
-                table.setPop( false );
-                runner().remove( table.index( ) );
-                stack.setTop( stack.top( ) - 1 );
+                data = *( void** ) lua_touserdata( lua, index - 1 );
             }
+            
+            lua_pop( lua, 1 );
+        }
+        
+        if ( !data )
+        {
+            data = runner().toinstance( index );
+        }
+        
+        if ( data )
+        {
+            stack.setTop( stack.top( ) - 1 );
+            self = true;
         }
         
         return data;
@@ -136,15 +268,14 @@ namespace lua
     {
         _runner = &stack.runner();
         
-        void* data = NULL;
-        if ( stack.type() == Table )
-        {
-            data = instance( stack );
-        }
+        //
+        //  methods of global objects carry the instance, others get it as the first argument
+        //
+        auto data = runner().touserdata( lua_upvalueindex( 2 ) );
         
         if ( !data )
         {
-            data = runner().touserdata( lua_upvalueindex( 2 ) );
+            data = instance( stack );
         }
         
         auto call = ( Call* ) runner().touserdata( lua_upvalueindex( 1 ) );
@@ -169,17 +300,18 @@ namespace lua
         try
         {
             h::Stack stack( runner );
+            Dispatch dispatch;
 
-            Dispatch()( stack );
+            dispatch( stack );
             count = stack.count();
             
             if ( stack.top( ) )
             {
-                assert( lua_gettop( lua ) == stack.top( ) );
+                assert( lua_gettop( lua ) == ( int ) ( stack.top( ) + dispatch.self ) );
             }
             else
             {
-                assert( lua_gettop( lua ) == stack.count( ) );
+                assert( lua_gettop( lua ) == ( int ) ( stack.count( ) + dispatch.self ) );
             }
         }
 
@@ -204,6 +336,22 @@ namespace lua
         }
 
         auto& main = Main::get();
+        lua_State* lua = main;
+        
+        //
+        //  the metatable exists before the methods, they get it as upvalue to check self
+        //
+        lua_createtable( lua, 0, 3 );
+        
+        lua_pushcfunction( lua, Object::gcStatic );
+        lua_setfield( lua, -2, "__gc" );
+        
+        lua_pushcfunction( lua, newindex );
+        lua_setfield( lua, -2, "__newindex" );
+        
+        main.setinstance( -1 );
+        m_metatable = luaL_ref( lua, LUA_REGISTRYINDEX );
+        
         h::Table table( main );
         
         auto& calls = object.calls();
@@ -213,6 +361,11 @@ namespace lua
             auto inserted = m_calls.insert( value );
             auto& call = ( inserted.first )->second;
             
+            if ( inserted.second )
+            {
+                call.index = m_calls.size() - 1;
+            }
+            
             h::Arguments upvalues;
             upvalues.add( &call );
 
@@ -220,14 +373,121 @@ namespace lua
             {
                 upvalues.add( ( void* ) object.data() );
             }
+            else
+            {
+                upvalues.addReference( m_metatable );
+            }
             
             table.set( call.name, dispatch, upvalues );
         } );
         
+        object.onMethods( table );
+        
         {
             h::Stack stack( main, 1 );
             m_reference = stack.reference();
         }
+        
+        main.pushReference( m_metatable );
+        main.pushReference( m_reference );
+        lua_setfield( lua, -2, "__index" );
+        lua_pop( lua, 1 );
+        
+        accelerate( object );
+    }
+    
+    //
+    //  the first field set on an instance gives it its own metatable with a table of fields
+    //  in front of the methods, instances without fields keep the shared metatable
+    //
+    int Main::Router::newindex( lua_State* lua )
+    {
+        lua_settop( lua, 3 );
+        
+        if ( !lua_getmetatable( lua, 1 ) )
+        {
+            return luaL_error( lua, "cannot set a field on this object" );
+        }
+        
+        lua_createtable( lua, 0, 4 );
+        
+        lua_getfield( lua, 4, "__gc" );
+        lua_setfield( lua, -2, "__gc" );
+        
+        lua_createtable( lua, 0, 1 );
+        lua_createtable( lua, 0, 1 );
+        lua_getfield( lua, 4, "__index" );
+        lua_setfield( lua, -2, "__index" );
+        lua_setmetatable( lua, -2 );
+        
+        lua_pushvalue( lua, -1 );
+        lua_setfield( lua, -3, "__index" );
+        lua_setfield( lua, -2, "__newindex" );
+        
+        Main::get().setinstance( -1 );
+        lua_setmetatable( lua, 1 );
+        
+        lua_getmetatable( lua, 1 );
+        lua_getfield( lua, -1, "__newindex" );
+        lua_pushvalue( lua, 2 );
+        lua_pushvalue( lua, 3 );
+        lua_rawset( lua, -3 );
+        
+        return 0;
+    }
+    
+    void Main::Router::accelerate( const Object& object ) const
+    {
+        if ( !object.exports() )
+        {
+            return;
+        }
+        
+        auto& main = Main::get();
+        lua_State* lua = main;
+        auto top = lua_gettop( lua );
+        
+        main.pushReference( m_reference );
+        auto methods = lua_gettop( lua );
+        
+        main.global( name() );
+        if ( lua_istable( lua, -1 ) )
+        {
+            lua_getfield( lua, -1, "ffi" );
+        }
+        
+        if ( lua_istable( lua, -1 ) )
+        {
+            lua_getfield( lua, -1, object.exports() );
+        }
+        
+        //
+        //  wrappers are registered as factories getting the method they replace and the metatable
+        //  of the instances, so they only pass vega objects of the class to C
+        //
+        auto wrappers = lua_gettop( lua );
+        if ( lua_istable( lua, wrappers ) )
+        {
+            lua_pushnil( lua );
+            while ( lua_next( lua, wrappers ) )
+            {
+                lua_pushvalue( lua, -2 );
+                lua_gettable( lua, methods );
+                lua_rawgeti( lua, LUA_REGISTRYINDEX, m_metatable );
+                
+                if ( lua_pcall( lua, 2, 1, 0 ) )
+                {
+                    lua_pop( lua, 1 );
+                    continue;
+                }
+                
+                lua_pushvalue( lua, -2 );
+                lua_insert( lua, -2 );
+                lua_settable( lua, methods );
+            }
+        }
+        
+        lua_settop( lua, top );
     }
     
     void Main::init() 
@@ -288,18 +548,19 @@ namespace lua
     
     void Object::push( Runner& runner ) 
     {
-        h::Table table( runner );
-        Main::Index( this )( table );
-
-        auto data = ( void* ) &m_data;
+        auto& router = Main::Index( this ).router();
         
-        h::Data udata( runner );
-        udata( gcStatic, data );
+        //
+        //  a single full userdata with the metatable of the class, 
+        //  so dispatching a call does not look anything up
+        //
+        auto data = ( const Data** ) runner.userdata( sizeof( Data* ) );
+        *data = &m_data;
         
-        table.setIndex( -2 );
-        table.setfield( "__u" );
-
-        table.set( "__instance", data );
+        runner.pushReference( router.metatable() );
+        runner.setmetatable( -2 );
+        
+        onIndex( router, runner );
         assign( runner );
     }
     
@@ -323,7 +584,7 @@ namespace lua
     
     int Object::gcStatic( lua_State* lua )
     {
-        auto instance = Data::get( lua_touserdata( lua, lua_upvalueindex( 1 ) ) );
+        auto instance = Data::get( *( void** ) lua_touserdata( lua, 1 ) );
         instance->gc( );
         return 0;
     }
@@ -366,6 +627,7 @@ namespace lua
     {
         auto runner = Runner::create( );
         runner->females().add( *this );
+        m_runners++;
         
         return *runner;
     }
@@ -376,17 +638,106 @@ namespace lua
         dispatch( Close, *this );
     }
     
+    void Main::wake( Runner& runner )
+    {
+        if ( runner.m_queued )
+        {
+            return;
+        }
+        
+        runner.ref();
+        runner.m_queued = true;
+        
+        if ( m_tail )
+        {
+            m_tail->m_next = &runner;
+        }
+        else
+        {
+            m_head = &runner;
+        }
+        
+        m_tail = &runner;
+        m_ready++;
+        
+        if ( !m_scheduled )
+        {
+            m_scheduled = true;
+            tau::base::event( this )();
+        }
+    }
+    
+    Runner* Main::dequeue()
+    {
+        auto runner = m_head;
+        if ( !runner )
+        {
+            return NULL;
+        }
+        
+        m_head = runner->m_next;
+        if ( !m_head )
+        {
+            m_tail = NULL;
+        }
+        
+        runner->m_next = NULL;
+        runner->m_queued = false;
+        m_ready--;
+        
+        return runner;
+    }
+    
+    void Main::resume( tau::Grain& grain )
+    {
+        auto& timer = dynamic_cast< tau::base::Timer& >( grain );
+        auto type = timer.type();
+        timer.deref();
+        
+        if ( type == Collect )
+        {
+            collect();
+            return;
+        }
+        
+        m_scheduled = false;
+        
+        for ( unsigned int i = 0; i < m_batch; i++ )
+        {
+            auto runner = dequeue();
+            if ( !runner )
+            {
+                break;
+            }
+            
+            if ( runner->suspended() )
+            {
+                runner->run();
+            }
+            
+            runner->deref();
+        }
+        
+        //
+        //  the rest is left to the next loop iteration so other events are not starved
+        //
+        if ( m_head && !m_scheduled )
+        {
+            m_scheduled = true;
+            tau::base::event( this )();
+        }
+    }
+    
     void Main::runnerStopped( tau::Grain& grain )
     {
         ENTER();
         auto& runner = dynamic_cast< Runner& >( grain );
         m_success = m_success & runner.success();
-    }
-    
-    void Main::timer( tau::Grain& grain )
-    {
-        State::gc();
-        ( dynamic_cast< tau::base::Timer& >( grain ) ).deref();
+        
+        if ( m_runners )
+        {
+            m_runners--;
+        }
     }
     
     void Runner::init( )
@@ -427,6 +778,7 @@ namespace lua
         
         init();
         setStatus( Running );
+        main().m_events++;
         
         int result = 0;
         try
@@ -445,6 +797,7 @@ namespace lua
         }
         else
         {
+            m_finished = !result && status() != Error;
             stop();
         }
     }
@@ -464,18 +817,17 @@ namespace lua
     }
     
     Runner::Runner( )
-    : m_start( NULL ), m_status( Stopped ), m_exception( NULL ), m_data( this ), m_way( *this )
+    : m_start( NULL ), m_status( Stopped ), m_exception( NULL ), m_data( this ), m_way( *this ), m_next( NULL ), m_queued( false ), m_finished( false )
     {
         ENTER();
         
         tau::in::Female::handler( Main::Close, ( Runner::Handler ) &Runner::mainStopped );
-        tau::in::Female::handler( tau::base::Timer::Timeout, ( Runner::Handler ) &Runner::timer );
     }
     
     void Runner::next()
     {
         assert( suspended() );
-        tau::base::event( this )( );
+        main().wake( *this );
     }
     
     bool Runner::skip( Object* object ) const
@@ -494,19 +846,16 @@ namespace lua
         
         assert( !started() );
         
-        if ( !m_lua )
-        {
-            m_lua = main().thread();
-        }
+        auto thread = main().thread();
+        m_lua = thread.lua;
+        m_reference = thread.reference;
+        m_finished = false;
 
         State::setdata( &m_data );
         
         females().add( main() );
         main().females().add( *this );
         
-        m_reference = main().reference( );
-        main().pop( 1 );
-        
         setStatus( Started );
     } 
     
@@ -524,23 +873,17 @@ namespace lua
         deref();
     }
     
-    void Runner::timer( tau::Grain& grain )
-    {
-        run();
-        ( dynamic_cast< tau::Rock& >( grain ) ).deref();
-    }
-    
     void Runner::cleanup(  )
     {
         ENTER();
         
         if ( m_lua )
         {
+            main().release( Main::Thread( m_lua, m_reference ), m_finished );
             m_lua = NULL;
-            main().unref( m_reference );
             m_reference = 0;
             m_way.clear();
-            m_status = Stopped;
+            setStatus( Stopped );
             
             
             clear();
@@ -52,6 +52,67 @@ namespace lua
         {
             return m_success;
         }
+        
+        //
+        //  incremental collection policy of the line, the collector runs in slices
+        //  of at most budget microseconds, one per loop iteration while there is garbage
+        //
+        struct Collector
+        {
+            unsigned int pause;
+            unsigned int stepmul;
+            unsigned int budget;
+            unsigned int step;
+            
+            unsigned long time;
+            unsigned long cycles;
+            
+            Collector( );
+        };
+        
+        const Collector& collector() const
+        {
+            return m_collector;
+        }
+        
+        void collect();
+        
+        //
+        //  number of live runners, can be read from other lines
+        //
+        unsigned int runners() const
+        {
+            return m_runners;
+        }
+        
+        //
+        //  runners waiting for an event and runner resumes so far, can be read from other lines
+        //
+        unsigned int suspended() const
+        {
+            return m_suspended;
+        }
+        
+        unsigned long events() const
+        {
+            return m_events;
+        }
+        
+        //
+        //  woken runners waiting in the ready queue
+        //
+        unsigned int ready() const
+        {
+            return m_ready;
+        }
+        
+        //
+        //  memory in use by the lua state in kilobytes
+        //
+        unsigned int memory() const
+        {
+            return m_lua ? lua_gc( m_lua, LUA_GCCOUNT, 0 ) : 0;
+        }
 
         static Main& get();
         
@@ -59,7 +120,7 @@ namespace lua
         {
         public:
             Router( const Object& object )
-            : m_reference( 0 )
+            : m_reference( 0 ), m_metatable( 0 )
             {
                 add( object );  
             }
@@ -68,22 +129,35 @@ namespace lua
             {
                 return m_reference;
             }
+            
+            //
+            //  metatable shared by all the instances of the class
+            //
+            unsigned int metatable( ) const
+            {
+                return m_metatable;
+            }
 
             struct Call
             {
                 Method method;
                 std::string name;
                 unsigned int id;
+                
+                //
+                //  dense index of the call in the router
+                //
+                unsigned int index;
 
                 typedef std::map< const std::string, Call > Map;
 
                 Call( const std::string& _name, Method _method, unsigned int _id  )
-                : method( _method ), name( _name ), id( _id )
+                : method( _method ), name( _name ), id( _id ), index( 0 )
                 {
                 }
 
                 Call( const Call& call )
-                : method( call.method ), name( call.name ), id( call.id )
+                : method( call.method ), name( call.name ), id( call.id ), index( call.index )
                 {
                 }
             };
@@ -95,15 +169,22 @@ namespace lua
             
         private:
             static int dispatch( lua_State* lua );
+            static int newindex( lua_State* lua );
             void add( const Object& object );
+            void accelerate( const Object& object ) const;
             
             struct Dispatch
             {
                 Object* object;
                 Runner* _runner;
                 
+                //
+                //  self is left on the stack below the arguments
+                //
+                bool self;
+                
                 Dispatch( )
-                : object( NULL ), _runner( NULL )
+                : object( NULL ), _runner( NULL ), self( false )
                 {
                     
                 }
@@ -120,21 +201,50 @@ namespace lua
             
         private:
             unsigned int m_reference; 
+            unsigned int m_metatable;
             Call::Map m_calls;
         };
         
     private:
+        enum Timers
+        {
+            Collect = 1
+        };
+        
         void gc();
         
         void runnerStopped( tau::Grain& grain );
-        void timer( tau::Grain& grain );
+        
+        //
+        //  woken runners are queued in order and resumed from a single loop event 
+        //  in batches of at most m_batch runners
+        //
+        void wake( Runner& runner );
+        void resume( tau::Grain& grain );
+        Runner* dequeue();
         
         void init();
         
-        lua_State* thread() const
+        //
+        //  lua threads anchored in the registry, finished ones are reset and reused by new runners
+        //
+        struct Thread
         {
-            return lua_newthread( m_lua );
-        }
+            lua_State* lua;
+            unsigned int reference;
+            
+            Thread( lua_State* _lua = NULL, unsigned int _reference = 0 )
+            : lua( _lua ), reference( _reference )
+            {
+            }
+        };
+        
+#define MAIN_THREADS_MIN 16
+#define MAIN_THREADS_MAX 1024
+        
+        Thread thread();
+        void release( const Thread& thread, bool finished );
+        Thread create() const;
         
         typedef std::unordered_map< unsigned int, Router* > Routers;
         
@@ -149,6 +259,7 @@ namespace lua
                 
             }
             
+            Router& router();
             void operator()( h::Table& table );
         };
         
@@ -158,6 +269,17 @@ namespace lua
         Script m_script;
         bool m_success;
         bool m_init;
+        std::atomic< unsigned int > m_runners;
+        std::atomic< unsigned int > m_suspended;
+        std::atomic< unsigned long > m_events;
+        std::vector< Thread > m_threads;
+        Collector m_collector;
+        bool m_garbage;
+        Runner* m_head;
+        Runner* m_tail;
+        std::atomic< unsigned int > m_ready;
+        unsigned int m_batch;
+        bool m_scheduled;
     };
     
     class Object: public tau::in::Female
@@ -268,8 +390,26 @@ namespace lua
             return m_runners.second;
         }
         
-        virtual void onIndex( const Main::Router& router, h::Table& table )
+        //
+        //  called for every instance handed over to lua with the instance on top of the stack
+        //
+        virtual void onIndex( const Main::Router& router, const State& lua )
+        {
+        }
+        
+        //
+        //  called once per class with the table of methods shared by the instances
+        //
+        virtual void onMethods( h::Table& table ) const
+        {
+        }
+        
+        //
+        //  key of the lua wrappers in __vega.ffi replacing methods exported to the ffi
+        //
+        virtual const char* exports( ) const
         {
+            return NULL;
         }
         
         void push( Runner& runner );
@@ -438,6 +578,11 @@ namespace lua
         
         void setStatus( Status status )
         {
+            if ( ( status == Suspended ) != suspended() )
+            {
+                status == Suspended ? main().m_suspended++ : main().m_suspended--;
+            }
+            
             m_status = status;
         }
         
@@ -481,8 +626,6 @@ namespace lua
             stop();
         }
         
-        void timer( tau::Grain& grain );
-        
     private:
         unsigned int m_reference;
         types::Function* m_start;
@@ -490,6 +633,13 @@ namespace lua
         Exception* m_exception;
         Data m_data;
         Way m_way;
+        Runner* m_next;
+        bool m_queued;
+        
+        //
+        //  the body returned from its last resume, the thread can run another one
+        //
+        bool m_finished;
     };
 }
 #endif	
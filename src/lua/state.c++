@@ -3,6 +3,8 @@
 
 namespace lua
 {
+    char State::s_instance;
+    
     std::string State::traceback( ) const
     {
         h::Table table( *this, "debug" );
@@ -94,9 +96,11 @@ namespace lua
         grow( [ & ]( ) { lua_getglobal( m_lua, name.c_str( ) ); } );
     }
     
-    void State::userdata( ) const
+    void* State::userdata( unsigned int size ) const
     {
-        grow( [ & ]( ){ lua_newuserdata( m_lua, 1 ); } );
+        void* data = NULL;
+        grow( [ & ]( ){ data = lua_newuserdata( m_lua, size ); } );
+        return data;
     }
     void State::getfield( int index, const std::string& name ) const
     {
@@ -151,6 +155,42 @@ namespace lua
         return data;
     }
     
+    //
+    //  objects are full userdata holding the pointer to the object data, 
+    //  told from other userdata by the mark on their metatable
+    //
+    void* State::toinstance( int index ) const
+    {
+        void* data = NULL;
+        if ( lua_type( m_lua, index ) == LUA_TUSERDATA && lua_checkstack( m_lua, 2 ) && lua_getmetatable( m_lua, index ) )
+        {
+            lua_pushlightuserdata( m_lua, &s_instance );
+            lua_rawget( m_lua, -2 );
+            
+            if ( lua_toboolean( m_lua, -1 ) )
+            {
+                data = *( void** ) lua_touserdata( m_lua, index < 0 && index > LUA_REGISTRYINDEX ? index - 2 : index );
+            }
+            
+            lua_pop( m_lua, 2 );
+        }
+        
+        return data;
+    }
+    
+    void State::setinstance( int index ) const
+    {
+        if ( index < 0 && index > LUA_REGISTRYINDEX )
+        {
+            index = lua_gettop( m_lua ) + index + 1;
+        }
+        
+        lua_checkstack( m_lua, 2 );
+        lua_pushlightuserdata( m_lua, &s_instance );
+        lua_pushboolean( m_lua, 1 );
+        lua_rawset( m_lua, index );
+    }
+    
     long State::tonumber( int index ) const
     {
         long number = 0;
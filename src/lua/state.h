@@ -15,6 +15,7 @@ namespace lua
         Number = LUA_TNUMBER,
         Boolean = LUA_TBOOLEAN,
         Function = LUA_TFUNCTION,
+        Userdata = LUA_TUSERDATA,
         Nil = LUA_TNIL
     };
     
@@ -83,7 +84,11 @@ namespace lua
         
         template< class Push > void grow( Push push ) const
         {
-            lua_checkstack( m_lua, 1 );
+            if ( !lua_checkstack( m_lua, 1 ) )
+            {
+                throw Exception( "lua stack overflow" );
+            }
+            
             push();
         }
         
@@ -121,7 +126,7 @@ namespace lua
                 
         int error( const std::string& message ) const;
         void table() const;
-        void userdata() const;
+        void* userdata( unsigned int size ) const;
         void pushvalue( int index ) const;
         
         void load( const Script& script ) const;
@@ -154,6 +159,17 @@ namespace lua
         }
         
         void* touserdata( int index ) const;
+        
+        //
+        //  data of a vega object, NULL for anything else including foreign userdata
+        //
+        void* toinstance( int index ) const;
+        
+        //
+        //  marks the metatable at index as the one of a class of vega objects
+        //
+        void setinstance( int index ) const;
+        
         std::string tostring( int index, bool force = false ) const;
         tau::Pill topill( int index ) const;
         bool toboolean( int index ) const;
@@ -213,6 +229,11 @@ namespace lua
         static lua_State* create();
         template< class Check > void check( Check check ) const;
         
+        //
+        //  its address is the key marking metatables of vega objects
+        //
+        static char s_instance;
+        
     protected:
         lua_State* m_lua;
         
@@ -2,556 +2,2899 @@
 #include "types.h"
 #include "helpers.h"
 
+#include <cmath>
+
 
 namespace lua
 {
     namespace types
     {                
-        void Value::dump( tau::Pill& pill, const Value& value )
-        {
-            unsigned int offset = sizeof( Header );
-            
-            pill.setOffset( offset );
-            value.dump( pill );
-            
-            pill.setOffset( 0 );
-            Header header( pill.length() );
-            
-            pill.cbuffer().copy( 0, ( const char* ) &header, offset );
-            pill.inc( offset );
-        }
-
-        void Value::dump( tau::Pill& pill ) const
+        //
+        //  finalizer of murmur3, every bit of the input flips half of the output
+        //
+        static unsigned long avalanche( unsigned long value )
         {
-            pill.add(  &m_type, sizeof( m_type ) );
-            data( pill );
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdUL;
+            value ^= value >> 33;
+            value *= 0xc4ceb9fe1a85ec53UL;
+            value ^= value >> 33;
+            return value;
         }
-
-        Value* Value::create( tau::Pill& pill ) 
+        
+        void Encoder::varint( unsigned long value )
         {
-            auto type = *pill.contents();
-            auto value = dynamic_cast< Value* >( tau::grain( type ) );
+            char buffer[ 10 ];
+            unsigned int size = 0;
             
-            pill.move( sizeof( type ) );
-            if ( value )
+            while ( value >= 0x80 )
             {
-                value->setType( type );
-                value->init( pill );
+                buffer[ size++ ] = ( char ) ( value | 0x80 );
+                value >>= 7;
             }
             
-            return value;
+            buffer[ size++ ] = ( char ) value;
+            m_data.append( buffer, size );
         }
         
-        const tau::Grain::Generators& Value::populate()
-        {            
-            ENTER();
-            
-            tau::add( LUA_TBOOLEAN, ( tau::Grain::Generator ) &Simple::create );
-            tau::add( LUA_TNUMBER, ( tau::Grain::Generator ) &Simple::create );
-            tau::add( LUA_TSTRING, ( tau::Grain::Generator ) &String::create );
-            tau::add( LUA_TFUNCTION, ( tau::Grain::Generator ) &Function::create );
-            tau::add( LUA_TTABLE, ( tau::Grain::Generator ) &Table::create );
-                    
-            return *tau::generators( LUA_TBOOLEAN );
+        void Encoder::bytes( const char* data, unsigned long length )
+        {
+            varint( length );
+            m_data.append( data, length );
         }
-
-        Value* Value::load( tau::Pill& pill ) 
+        
+        //
+        //  integers go as zigzag varints or as the tag itself, the rest as 8 byte doubles
+        //
+        void Encoder::number( double value )
         {
-            if ( pill.length() < sizeof( Header ) )
+            if ( value >= -( 1L << 53 ) && value <= ( 1L << 53 ) && value == ( long ) value && !( value == 0 && std::signbit( value ) ) )
             {
-                return NULL;
+                long integer = value;
+                if ( integer >= 0 && integer < 0x80 )
+                {
+                    tag( Tag::Small | integer );
+                    return;
+                }
+                
+                tag( Tag::Integer );
+                varint( ( ( unsigned long ) integer << 1 ) ^ ( unsigned long ) ( integer >> 63 ) );
+                return;
             }
             
-            Header* header = ( Header* ) pill.contents();
-            if ( pill.length() < sizeof( Header ) + header->size )
-            {
-                return NULL;
-            }
-
-            pill.move( sizeof( Header ) );
-            auto value = create( pill );
-            pill.setOffset( 0 );
-            return value;
+            tag( Tag::Double );
+            m_data.append( ( const char* ) &value, sizeof( value ) );
         }
         
-        Function::~Function( )
-        {
-            cleanup();
-        }
-        
-        void Function::cleanup()
+        void Encoder::string( const char* data, unsigned long length )
         {
-            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
+            if ( length >= TYPES_STRING_MIN && length <= TYPES_STRING_MAX )
             {
-                ( *i )->destroy();
+                std::string value( data, length );
+                
+                auto found = m_strings.find( value );
+                if ( found != m_strings.end() )
+                {
+                    tag( Tag::Reference );
+                    varint( found->second );
+                    return;
+                }
+                
+                if ( m_strings.size() < TYPES_STRINGS_MAX )
+                {
+                    m_strings[ value ] = m_order.size();
+                    m_order.push_back( value );
+                }
             }
             
-            m_upvalues.clear();
-            m_script = NULL;
-            m_reference = 0;
-            m_buffer.clear();
+            tag( Tag::String );
+            bytes( data, length );
         }
         
-        void Table::cleanup()
+        //
+        //  strings first written after the mark are forgotten, the decoder never sees them
+        //
+        void Encoder::rollback( const Mark& mark )
         {
-            for ( auto i = m_map.begin( ); i != m_map.end( ); i++ )
+            m_data.resize( mark.position );
+            
+            while ( m_order.size() > mark.strings )
             {
-                i->first->destroy();
-                i->second->destroy();
+                m_strings.erase( m_order.back() );
+                m_order.pop_back();
             }
             
-            m_map.clear();
-
-            if ( m_mt )
+            while ( m_shapes.size() > mark.shapes )
             {
-                m_mt->destroy();
-                m_mt = NULL;
+                auto range = m_signatures.equal_range( m_shapes.back().signature );
+                for ( auto i = range.first; i != range.second; i++ )
+                {
+                    if ( i->second == m_shapes.size() - 1 )
+                    {
+                        m_signatures.erase( i );
+                        break;
+                    }
+                }
+                
+                m_shapes.pop_back();
             }
         }
-
-        Table::~Table( )
-        {
-            cleanup();
-        }
-
-        void Function::push( const State& lua ) const
+        
+        void Encoder::patch( unsigned long position, unsigned long value )
         {
-            if ( m_reference )
-            {
-                lua.pushReference( m_reference );
-                return;
-            }
-            
-            if ( m_script )
+            if ( value < 0x80 )
             {
-                lua.load( *m_script );
+                m_data[ position ] = ( char ) value;
                 return;
             }
             
-
-            lua.grow([ & ] ( ) { lua_load( lua, readerStatic, ( void* ) this, "" ); } );
-            
-            assert( lua_isfunction( lua, -1 ) );
-            unsigned int count = 1;
+            auto size = m_data.size();
+            varint( value );
             
-            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
-            {
-                ( *i )->push( lua );
-                assert( lua_setupvalue( lua, -2, count ) );
-                count++;
-            }
+            //
+            //  the varint went to the end, it is moved over the reserved byte
+            //
+            std::string count( m_data, size );
+            m_data.resize( size );
+            m_data.replace( position, 1, count );
         }
-
-        void Table::push( const State& lua ) const
+        
+        bool Encoder::value( const State& lua, int index, Visited& visited, bool copy )
         {
-            lua.table();
-
-            for ( auto i = m_map.begin( ); i != m_map.end( ); i++ )
+            if ( index < 0 )
             {
-                i->first->push( lua );
-                i->second->push( lua );
-                lua_settable( lua, -3 );
+                index = lua_gettop( lua ) + index + 1;
             }
-
-            if ( m_mt )
+            
+            auto type = lua_type( lua, index );
+            
+            switch ( type )
             {
-                m_mt->push( lua );
-                lua_setmetatable( lua, -2 );
-            }
-        }
-
-        void String::init( tau::Pill& pill )
-        {
-            auto length = *( unsigned int* ) pill.contents();
-            auto size = sizeof( length );
-            m_value.append( pill.contents() + size, length );
-            pill.move( m_value.length() + size );
-        }
-
-        void String::data( tau::Pill& pill ) const
-        {            
-            unsigned int size = m_value.size( );
-            pill.add( ( char* ) &size, sizeof( size ) );
-            pill.add( m_value.data( ), m_value.size( ) );
-        }
-
-        void Simple::init( tau::Pill& pill )
-        {
-            m_value = *( long* ) pill.contents();
-            pill.move( sizeof( m_value ) );
-        }
-        
-        void Simple::data( tau::Pill& pill ) const
-        {
-            pill.add( ( char* ) &m_value, sizeof( m_value ) );
-        }
-        
-        void Function::data( tau::Pill& pill ) const
-        {
-            unsigned int size = m_buffer.size( );
-            pill.add( ( char* ) &size, sizeof( size ) );
-            pill.add( m_buffer );
-
-            size = m_upvalues.size();
-            pill.add( ( char* ) &size, sizeof( size ) );
+                case LUA_TBOOLEAN:
+                    boolean( lua_toboolean( lua, index ) );
+                    return true;
                     
-            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
-            {
-                auto value = *i;
-                value->dump( pill );
+                case LUA_TNUMBER:
+                    number( lua_tonumber( lua, index ) );
+                    return true;
+                    
+                case LUA_TSTRING:
+                {
+                    size_t length = 0;
+                    auto data = lua_tolstring( lua, index, &length );
+                    string( data, length );
+                    return true;
+                }
+                    
+                case LUA_TTABLE:
+                case LUA_TFUNCTION:
+                    break;
+                    
+                default:
+                    return false;
             }
-        }
-
-        void Function::init( tau::Pill& pill )
-        {
-            auto size = *( unsigned int* ) pill.contents();
-            auto offset = sizeof( size );
             
-            m_buffer.add( pill.contents() + offset, size );
-            offset += m_buffer.size( );
-            unsigned int upvalues = *( unsigned int* ) ( pill.contents() + offset );
-            offset += sizeof( unsigned int );
+            //
+            //  cycles and shared values are handled as in Value::load
+            //
+            auto pointer = lua_topointer( lua, index );
+            auto mark = visited.mark( pointer );
             
-            pill.move( offset );
+            if ( mark == Visited::Open )
+            {
+                return false;
+            }
             
-            while( m_upvalues.size() < upvalues )
+            if ( mark == Visited::Closed && !copy && visited.shared() != Visited::Copy )
             {
-                m_upvalues.push_back( Value::create( pill ) );
+                if ( visited.shared() == Visited::Fail )
+                {
+                    visited.fail();
+                }
+                
+                return false;
             }
-        }
-
-        void Function::init( const State& lua, int index )
-        {
-            if ( lua_iscfunction( lua, index ) || !lua_isfunction( lua, index ) )
+            
+            if ( !visited.open( pointer ) )
             {
-                throw Exception( "cannot load function" );
+                return false;
             }
             
-            if ( index != -1 )
+            bool written = true;
+            if ( type == LUA_TTABLE )
             {
-                lua.pushvalue( index );
+                table( lua, index, visited );
+            }
+            else
+            {
+                written = function( lua, index, visited );
             }
-                
-            lua_dump( lua, writerStatic, ( void* ) this );
             
-            if ( index != -1 )
+            visited.close( pointer );
+            return written;
+        }
+        
+        //
+        //  the array part runs up to the first value that cannot be written, 
+        //  pairs are counted as they are written
+        //
+        void Encoder::table( const State& lua, int index, Visited& visited )
+        {
+            if ( shaped( lua, index, visited ) )
             {
-                lua.pop( 1 );
+                return;
             }
-
-            unsigned int counter = 1;
-            setId( lua, index );
+            
+            tag( Tag::Table );
+            
+            auto position = reserve();
+            unsigned long size = 0;
+            
             while ( true )
             {
-                const char* name = lua_getupvalue( lua, index, counter );
-                if ( !name )
+                lua.grow( [ & ]( ) { lua_rawgeti( lua, index, size + 1 ); } );
+                
+                bool written = !lua_isnil( lua, -1 ) && value( lua, -1, visited );
+                lua.pop( 1 );
+                
+                if ( !written )
                 {
                     break;
                 }
                 
-                Value* upvalue = NULL;
-                if ( Value::check( lua.objectid( -1 ) ) )
+                size++;
+            }
+            
+            patch( position, size );
+            
+            position = reserve();
+            unsigned long count = 0;
+            
+            lua_checkstack( lua, 2 );
+            lua_pushnil( lua );
+            
+            while ( lua_next( lua, index ) != 0 )
+            {
+                if ( lua_type( lua, -2 ) == LUA_TNUMBER )
                 {
-                    lua.pop( 1 );
-                    continue;
+                    auto key = lua_tonumber( lua, -2 );
+                    if ( key >= 1 && key <= size && key == ( unsigned long ) key )
+                    {
+                        lua.pop( 1 );
+                        continue;
+                    }
                 }
                 
-                upvalue = load( lua );
-                if ( upvalue )
+                auto mark = this->mark();
+                
+                if ( value( lua, -2, visited ) && value( lua, -1, visited ) )
                 {
-                    m_upvalues.push_back( upvalue );
+                    count++;
                 }
-                counter ++;
+                else
+                {
+                    rollback( mark );
+                }
+                
+                lua.pop( 1 );
             }
+            
+            patch( position, count );
+            metatable( lua, index, visited );
         }
-
-        bool Function::operator==( const Value& value ) const
+        
+        void Encoder::metatable( const State& lua, int index, Visited& visited )
         {
-            const Function& function = dynamic_cast < const Function& > ( value );
-            if ( m_buffer == function.m_buffer && m_upvalues.size() == function.m_upvalues.size() )
+            if ( lua_getmetatable( lua, index ) )
             {
-                for ( int i = 0; i < m_upvalues.size(); i++ )
+                if ( !value( lua, -1, visited, true ) )
                 {
-                    auto left = m_upvalues[ i ];
-                    auto right = function.m_upvalues[ i ];
-                    
-                    if ( !( *left == *right ) )
-                    {
-                        return false;
-                    }
+                    nil();
                 }
                 
-                return true;
+                lua.pop( 1 );
+            }
+            else
+            {
+                nil();
             }
-
-            return false;
         }
-
-        void Table::data( tau::Pill& pill ) const
+        
+        //
+        //  a table with only string keys is written as a shape, the first table with a set of keys
+        //  defines it and the next ones refer to it, values that cannot be written are nil
+        //
+        bool Encoder::shaped( const State& lua, int index, Visited& visited )
         {
-            unsigned int size = m_map.size( );
+            m_keys.clear();
+            unsigned long signature = 0;
+            
+            lua_checkstack( lua, 2 );
+            lua_pushnil( lua );
             
-            pill.add( ( char* ) &size, sizeof( size ) );
+            while ( lua_next( lua, index ) != 0 )
+            {
+                if ( lua_type( lua, -2 ) != LUA_TSTRING || m_keys.size() == TYPES_SHAPE_KEYS_MAX )
+                {
+                    lua.pop( 2 );
+                    return false;
+                }
+                
+                Key key;
+                key.data = lua_tolstring( lua, -2, &key.length );
+                
+                m_keys.push_back( key );
+                signature += avalanche( ( uintptr_t ) key.data );
+                lua.pop( 1 );
+            }
             
-            for ( auto i = m_map.begin( ); i != m_map.end( ); i++ )
+            if ( m_keys.empty() )
             {
-                i->first->dump( pill );
-                i->second->dump( pill );
+                return false;
             }
-            if ( m_mt )
+            
+            signature ^= m_keys.size();
+            
+            //
+            //  same count and signature, the keys are the same if all of them are in the shape
+            //
+            int id = -1;
+            auto range = m_signatures.equal_range( signature );
+            
+            for ( auto i = range.first; i != range.second && id < 0; i++ )
             {
-                m_mt->dump( pill );
+                auto& shape = m_shapes[ i->second ];
+                if ( shape.keys.size() != m_keys.size() )
+                {
+                    continue;
+                }
+                
+                bool same = true;
+                for ( auto j = m_keys.begin(); j != m_keys.end() && same; j++ )
+                {
+                    same = std::binary_search( shape.sorted.begin(), shape.sorted.end(), j->data );
+                }
+                
+                if ( same )
+                {
+                    id = i->second;
+                }
             }
-            else
+            
+            if ( id < 0 && m_shapes.size() == TYPES_SHAPES_MAX )
             {
-                Value value;
-                value.dump( pill );
+                return false;
             }
-        }
-
-        Table::Values Table::parseTable( tau::Pill& pill )
-        {
-            auto count = *( unsigned int* ) pill.contents();
-            pill.move( sizeof( count ) );
-
-            Values map;
-
-            for ( unsigned int i = 0; i < count; i++ )
+            
+            if ( id < 0 )
             {
+                id = m_shapes.size();
+                m_shapes.push_back( Shape() );
                 
-                Value* key = NULL;
-                Value* value = NULL;
-
-                while ( true )
+                auto& shape = m_shapes.back();
+                shape.keys = m_keys;
+                shape.signature = signature;
+                
+                for ( auto i = m_keys.begin(); i != m_keys.end(); i++ )
                 {
-                    auto loaded = Value::create( pill );
-                    
-                    if ( !loaded )
+                    shape.sorted.push_back( i->data );
+                }
+                
+                std::sort( shape.sorted.begin(), shape.sorted.end() );
+                m_signatures.insert( std::make_pair( signature, ( unsigned int ) id ) );
+                
+                tag( Tag::Shape );
+                varint( m_keys.size() );
+                
+                for ( auto i = m_keys.begin(); i != m_keys.end(); i++ )
+                {
+                    string( i->data, i->length );
+                }
+            }
+            else
+            {
+                tag( Tag::Shaped );
+                varint( id );
+            }
+            
+            //
+            //  values come in the order of the shape, which is the order of traversal 
+            //  unless the table was built in another order
+            //
+            bool ordered = true;
+            for ( unsigned int i = 0; i < m_keys.size() && ordered; i++ )
+            {
+                ordered = m_shapes[ id ].keys[ i ].data == m_keys[ i ].data;
+            }
+            
+            if ( ordered )
+            {
+                lua_pushnil( lua );
+                
+                while ( lua_next( lua, index ) != 0 )
+                {
+                    if ( !value( lua, -1, visited ) )
                     {
-                        assert( false );
-                        break;
+                        nil();
                     }
                     
-                    if ( !key )
-                    {
-                        key = loaded;
-                    }
-                    else if ( !value )
-                    {
-                        value = loaded;
-                    }
-
-                    if ( key && value )
+                    lua.pop( 1 );
+                }
+            }
+            else
+            {
+                auto keys = m_shapes[ id ].keys;
+                
+                for ( auto i = keys.begin(); i != keys.end(); i++ )
+                {
+                    lua_pushlstring( lua, i->data, i->length );
+                    lua_rawget( lua, index );
+                    
+                    if ( !value( lua, -1, visited ) )
                     {
-                        map[ key ] = value;
-                        break;
+                        nil();
                     }
+                    
+                    lua.pop( 1 );
                 }
             }
-
-            return map;
-        }
-
-        void Table::init( tau::Pill& pill )
-        {
-            m_map = parseTable( pill );
-            m_mt = dynamic_cast< Table* >( Value::create( pill ) );
+            
+            metatable( lua, index, visited );
+            return true;
         }
-
-        void Table::init( const State& lua, int index )
+        
+        bool Encoder::function( const State& lua, int index, Visited& visited )
         {
-            setId( lua, index );
-            unsigned int mt = 0;
-            if ( lua_getmetatable( lua, index ) )
+            if ( lua_iscfunction( lua, index ) )
             {
-                m_mt = dynamic_cast < Table* > ( load( lua, -1, false ) );
-                {
-                    h::Stack stack( lua, 1 );
-                    mt = stack.reference();
-                }
+                return false;
+            }
+            
+            std::string key;
+            
+            if ( m_cached && Prototypes::key( lua, index, key ) )
+            {
+                tag( Tag::Cached );
+                m_data.append( key );
+            }
+            else
+            {
+                m_code.clear();
                 
-                lua_newtable( lua );
-                lua_setmetatable( lua, index - 1 );
+                lua.pushvalue( index );
+                lua_dump( lua, writer, &m_code );
+                lua.pop( 1 );
+                
+                tag( Tag::Function );
+                bytes( m_code.data(), m_code.size() );
             }
-
-            lua_pushnil( lua );
-
-            while ( lua_next( lua, index - 1 ) != 0 )
+            
+            unsigned int upvalues = 0;
+            while ( lua_getupvalue( lua, index, upvalues + 1 ) )
+            {
+                lua.pop( 1 );
+                upvalues++;
+            }
+            
+            varint( upvalues );
+            
+            for ( unsigned int i = 1; i <= upvalues; i++ )
             {
-                if ( Value::check( lua.objectid( -1 ) ) )
+                lua_checkstack( lua, 1 );
+                lua_getupvalue( lua, index, i );
+                
+                if ( !value( lua, -1, visited ) )
                 {
-                    lua.pop( 1 );
-                    continue;
+                    nil();
                 }
                 
-                Value* value = load( lua, -1, true );
-                Value* key = load( lua, -1, false );
-                m_map[ key ] = value;
-            }
-
-            if ( mt )
-            {
-                lua.pushReference( mt );
-                lua_setmetatable( lua, index - 1 );
-                lua.unref( mt );
+                lua.pop( 1 );
             }
+            
+            return true;
         }
-
-        bool Table::operator==( const Value& value ) const
+        
+        int Encoder::writer( lua_State* lua, const void* data, size_t size, void* code )
         {
-            const Table& map = dynamic_cast < const Table& > ( value );
+            static_cast< std::string* >( code )->append( ( const char* ) data, size );
+            return 0;
+        }
+        
+        int Decoder::type( char tag, unsigned int version )
+        {
+            if ( version < 2 )
+            {
+                return tag;
+            }
             
-            if ( m_map.size( ) != map.m_map.size( ) )
+            if ( tag & Tag::Small )
             {
-                return false;
+                return LUA_TNUMBER;
             }
-
-            for ( auto i = m_map.begin( ); i != m_map.end( ); i++ )
+            
+            switch ( tag )
             {
-                auto second = ( const_cast< Table* >( &map ) )->value( i->first->tostring() );
-                if ( !second )
-                {
-                    return false;
-                }
+                case Tag::False:
+                case Tag::True:
+                    return LUA_TBOOLEAN;
+                    
+                case Tag::Integer:
+                case Tag::Double:
+                    return LUA_TNUMBER;
+                    
+                case Tag::String:
+                case Tag::Reference:
+                    return LUA_TSTRING;
+                    
+                case Tag::Function:
+                case Tag::Cached:
+                    return LUA_TFUNCTION;
+                    
+                case Tag::Table:
+                case Tag::Shape:
+                case Tag::Shaped:
+                    return LUA_TTABLE;
+                    
+                default:
+                    return LUA_TNIL;
+            }
+        }
+        
+        unsigned long Decoder::varint( )
+        {
+            unsigned long value = 0;
+            
+            for ( unsigned int shift = 0; shift < 64 && has( 1 ); shift += 7 )
+            {
+                auto byte = ( unsigned char ) *m_pill.contents();
+                m_pill.move( 1 );
                 
-                auto value = *i->second;
-                if ( !( value == *second ) )
+                value |= ( unsigned long ) ( byte & 0x7f ) << shift;
+                if ( !( byte & 0x80 ) )
                 {
-                    return false;
+                    break;
                 }
             }
             
-            if ( m_mt )
+            return value;
+        }
+        
+        unsigned long Decoder::length( )
+        {
+            if ( m_version >= 2 )
+            {
+                return varint();
+            }
+            
+            if ( !has( sizeof( unsigned int ) ) )
+            {
+                return 0;
+            }
+            
+            auto length = *( unsigned int* ) m_pill.contents();
+            m_pill.move( sizeof( length ) );
+            return length;
+        }
+        
+        double Decoder::number( char tag )
+        {
+            double number = 0;
+            
+            if ( m_version < 2 )
             {
-                if ( !map.m_mt )
+                if ( !has( sizeof( long ) ) )
                 {
-                    return false;
+                    return 0;
                 }
-                else
+                
+                number = *( long* ) m_pill.contents();
+                m_pill.move( sizeof( long ) );
+                return number;
+            }
+            
+            if ( tag & Tag::Small )
+            {
+                return ( unsigned char ) tag & ~Tag::Small;
+            }
+            
+            switch ( tag )
+            {
+                case Tag::True:
+                    return 1;
+                    
+                case Tag::Integer:
                 {
-                    return *m_mt == *map.m_mt;
+                    auto value = varint();
+                    return ( long ) ( value >> 1 ) ^ -( long ) ( value & 1 );
                 }
+                    
+                case Tag::Double:
+                    if ( has( sizeof( number ) ) )
+                    {
+                        number = *( double* ) m_pill.contents();
+                        m_pill.move( sizeof( number ) );
+                    }
+                    break;
             }
             
-            return true;
+            return number;
         }
         
-        void Table::index()
+        std::string Decoder::string( char tag )
         {
+            if ( m_version >= 2 && tag == Tag::Reference )
+            {
+                auto index = varint();
+                return index < m_strings.size() ? m_strings[ index ] : std::string();
+            }
             
-            if ( m_strings.size() )
+            auto size = length();
+            if ( !has( size ) )
             {
-                return;
+                return std::string();
             }
             
-            for ( auto i = m_map.begin(); i != m_map.end(); i++ )
+            std::string value( m_pill.contents(), size );
+            m_pill.move( size );
+            
+            if ( m_version >= 2 && size >= TYPES_STRING_MIN && size <= TYPES_STRING_MAX && m_strings.size() < TYPES_STRINGS_MAX )
             {
-                auto key = i->first->tostring();
-                auto value = i->second;
-                
-                m_strings[ key ] = i->second;
+                m_strings.push_back( value );
             }
             
-            std::string empty;
-            empty.append( "\0", 5 );
-            m_strings[ empty ] = NULL;
+            return value;
         }
-
-        const Value* Table::value( const std::string& key )
+        
+        void Decoder::push( const State& lua )
         {
-            index();
-            auto found = m_strings.find( key );
-            if ( found != m_strings.end() )
+            auto tag = this->tag();
+            
+            switch ( type( tag ) )
             {
-                return found->second;
+                case LUA_TBOOLEAN:
+                    lua.push( ( bool ) number( tag ) );
+                    break;
+                    
+                case LUA_TNUMBER:
+                {
+                    auto value = number( tag );
+                    lua.grow( [ & ]( ) { lua_pushnumber( lua, value ); } );
+                    break;
+                }
+                    
+                case LUA_TSTRING:
+                {
+                    if ( m_version >= 2 && tag == Tag::Reference )
+                    {
+                        auto index = varint();
+                        lua.push( index < m_strings.size() ? m_strings[ index ] : std::string() );
+                        break;
+                    }
+                    
+                    auto size = length();
+                    if ( !has( size ) )
+                    {
+                        lua.grow( [ & ]( ) { lua_pushnil( lua ); } );
+                        break;
+                    }
+                    
+                    lua.push( m_pill.contents(), size );
+                    
+                    if ( m_version >= 2 && size >= TYPES_STRING_MIN && size <= TYPES_STRING_MAX && m_strings.size() < TYPES_STRINGS_MAX )
+                    {
+                        m_strings.push_back( std::string( m_pill.contents(), size ) );
+                    }
+                    
+                    m_pill.move( size );
+                    break;
+                }
+                    
+                case LUA_TTABLE:
+                case LUA_TFUNCTION:
+                    if ( !enter() )
+                    {
+                        lua.grow( [ & ]( ) { lua_pushnil( lua ); } );
+                        break;
+                    }
+                    
+                    if ( type( tag ) == LUA_TTABLE )
+                    {
+                        table( lua, tag );
+                    }
+                    else
+                    {
+                        function( lua, tag );
+                    }
+                    
+                    leave();
+                    break;
+                    
+                default:
+                    lua.grow( [ & ]( ) { lua_pushnil( lua ); } );
             }
-            
-            return NULL;
         }
         
-        bool Value::check( const std::string& id ) const
+        const Decoder::Shape* Decoder::shape( char tag )
         {
-            if ( m_id == id )
+            if ( tag == Tag::Shaped )
             {
-                return true;
+                auto id = varint();
+                return id < m_shapes.size() ? &m_shapes[ id ] : NULL;
             }
             
-            if ( m_parent )
+            auto count = varint();
+            
+            m_shapes.push_back( Shape() );
+            auto& shape = m_shapes.back();
+            
+            shape.reserve( std::min< unsigned long >( count, TYPES_SHAPE_KEYS_MAX ) );
+            while ( shape.size() < count && !m_failed )
             {
-                return m_parent->check( id );
+                shape.push_back( string( this->tag() ) );
             }
             
-            return false;
+            return &shape;
         }
         
-        Value* Value::load( const State& lua, int index, bool pop, const Value* parent )
+        void Decoder::table( const State& lua, char tag )
         {
-            unsigned int type = lua_type( lua, index );
-            auto value = dynamic_cast< Value* >( tau::grain( type ) );
-                        
-            try
+            if ( m_version >= 3 && ( tag == Tag::Shape || tag == Tag::Shaped ) )
             {
-                if ( !value )
+                auto shape = this->shape( tag );
+                auto size = shape ? shape->size() : 0;
+                
+                lua.grow( [ & ]( ) { lua_createtable( lua, 0, size ); } );
+                lua_checkstack( lua, 2 );
+                
+                for ( unsigned int i = 0; i < size; i++ )
                 {
-                    throw Exception();
+                    lua.push( ( *shape )[ i ] );
+                    push( lua );
+                    lua_rawset( lua, -3 );
                 }
-
-                value->setParent( parent );
-                value->setType(  type );
-                value->init( lua, index );
-                
             }
-            catch( const Exception& )
+            else
             {
+                unsigned long size = m_version >= 2 ? varint() : 0;
                 
-                if ( value )
+                //
+                //  the count of pairs comes after the array part, lua grows the hash part as they are set
+                //
+                lua.grow( [ & ]( ) { lua_createtable( lua, std::min< unsigned long >( std::min( size, remaining() ), 1 << 16 ), 0 ); } );
+                lua_checkstack( lua, 2 );
+                
+                for ( unsigned long i = 1; i <= size && !m_failed; i++ )
                 {
-                    delete value;
+                    push( lua );
+                    lua_rawseti( lua, -2, i );
                 }
                 
-                value = NULL;
+                auto count = length();
+                
+                for ( unsigned long i = 0; i < count && !m_failed; i++ )
+                {
+                    push( lua );
+                    push( lua );
+                    
+                    if ( lua_isnil( lua, -2 ) )
+                    {
+                        lua.pop( 2 );
+                        continue;
+                    }
+                    
+                    lua_rawset( lua, -3 );
+                }
             }
-
-            if ( pop )
+            
+            push( lua );
+            
+            if ( lua_istable( lua, -1 ) )
+            {
+                lua_setmetatable( lua, -2 );
+            }
+            else
             {
                 lua.pop( 1 );
             }
-            
-            return value;
-        }
-
-        int Function::writerStatic( lua_State *lua, const void* buffer, size_t size, void* data )
-        {
-            return( reinterpret_cast < Function* > ( data ) )->writer( buffer, size );
-        }
-
-        int Function::writer( const void* data, size_t size )
-        {
-            m_buffer.add( ( const char* ) data, size );
-            return 0;
-        }
-
-        const char* Function::readerStatic( lua_State* lua, void* data, size_t* size )
-        {
-            return( reinterpret_cast < Function* > ( data ) )->reader( size );
         }
-
-        const char* Function::reader( size_t* size )
+        
+        //
+        //  chunk of function code handed to lua_load in one piece
+        //
+        struct Code
         {
-            *size = m_buffer.length( );
-            const char* data = m_buffer.data( );
-            m_buffer.clear( );
-            return data;
-        }
+            const char* data;
+            size_t size;
+        };
         
-        void Table::insert( const Type& pair )
+        const char* Decoder::reader( lua_State* lua, void* data, size_t* size )
         {
-            m_map.insert( pair );
+            auto code = static_cast< Code* >( data );
+            
+            *size = code->size;
+            code->size = 0;
+            return code->data;
         }
         
-        void Table::set( const std::string& key, Value* value )
+        void Decoder::function( const State& lua, char tag )
         {
-            insert( Type( new String( key ), value ) );
+            bool loaded = false;
+            lua_checkstack( lua, 2 );
+            
+            if ( m_version >= 2 && tag == Tag::Cached )
+            {
+                if ( has( PROTOTYPES_KEY_SIZE ) )
+                {
+                    std::string key( m_pill.contents(), PROTOTYPES_KEY_SIZE );
+                    m_pill.move( PROTOTYPES_KEY_SIZE );
+                    
+                    loaded = Prototypes::push( lua, key );
+                }
+                
+                if ( !loaded )
+                {
+                    lua_pushnil( lua );
+                }
+            }
+            else
+            {
+                auto size = length();
+                if ( has( size ) )
+                {
+                    Code code = { m_pill.contents(), size };
+                    
+                    loaded = !lua_load( lua, reader, &code, "" );
+                    m_pill.move( size );
+                }
+                else
+                {
+                    lua_pushnil( lua );
+                }
+            }
+            
+            auto upvalues = length();
+            
+            for ( unsigned long i = 1; i <= upvalues && !m_failed; i++ )
+            {
+                push( lua );
+                
+                if ( !loaded || !lua_setupvalue( lua, -2, i ) )
+                {
+                    lua.pop( 1 );
+                }
+            }
+            
+            //
+            //  code that does not load leaves nil as an upvalue that could not be dumped does
+            //
+            if ( !loaded )
+            {
+                lua.pop( 1 );
+                lua_pushnil( lua );
+            }
+        }
+        
+        void Value::dump( tau::Pill& pill, const Value& value )
+        {
+            pill.setOffset( sizeof( Header ) );
+            
+            Encoder encoder( pill );
+            value.dump( encoder );
+            encoder.flush();
+            
+            seal( pill );
+        }
+        
+        bool Value::dump( tau::Pill& pill, const State& lua, int index, Visited::Shared shared, bool cached )
+        {
+            pill.setOffset( sizeof( Header ) );
+            
+            Visited visited( shared );
+            Encoder encoder( pill, cached );
+            
+            if ( !encoder.value( lua, index, visited ) || visited.failed() )
+            {
+                pill.setOffset( 0 );
+                return false;
+            }
+            
+            encoder.flush();
+            seal( pill );
+            return true;
+        }
+        
+        //
+        //  writes the header in the room left at the start of the pill
+        //
+        void Value::seal( tau::Pill& pill )
+        {
+            unsigned int offset = sizeof( Header );
+            
+            pill.setOffset( 0 );
+            Header header( pill.length() );
+            
+            pill.cbuffer().copy( 0, ( const char* ) &header, offset );
+            pill.inc( offset );
+        }
+        
+        const Value::Header* Value::header( const tau::Pill& pill )
+        {
+            if ( pill.length() < sizeof( Header ) )
+            {
+                return NULL;
+            }
+            
+            auto header = ( const Header* ) pill.contents();
+            if ( pill.length() < sizeof( Header ) + header->size || !header->version || header->version > TYPES_VERSION )
+            {
+                return NULL;
+            }
+            
+            return header;
+        }
+
+        Value* Value::create( Decoder& decoder ) 
+        {
+            return create( decoder, decoder.tag() );
+        }
+        
+        Value* Value::create( Decoder& decoder, char tag ) 
+        {
+            auto type = decoder.type( tag );
+            bool nested = type == LUA_TTABLE || type == LUA_TFUNCTION;
+            
+            if ( nested && !decoder.enter() )
+            {
+                return NULL;
+            }
+            
+            auto value = type ? dynamic_cast< Value* >( tau::grain( type ) ) : NULL;
+            
+            if ( value )
+            {
+                value->setType( type );
+                value->init( decoder, tag );
+            }
+            
+            if ( nested )
+            {
+                decoder.leave();
+            }
+            
+            return value;
+        }
+        
+        const tau::Grain::Generators& Value::populate()
+        {            
+            ENTER();
+            
+            tau::add( LUA_TBOOLEAN, ( tau::Grain::Generator ) &Simple::create );
+            tau::add( LUA_TNUMBER, ( tau::Grain::Generator ) &Simple::create );
+            tau::add( LUA_TSTRING, ( tau::Grain::Generator ) &String::create );
+            tau::add( LUA_TFUNCTION, ( tau::Grain::Generator ) &Function::create );
+            tau::add( LUA_TTABLE, ( tau::Grain::Generator ) &Table::create );
+                    
+            return *tau::generators( LUA_TBOOLEAN );
+        }
+
+        Value* Value::load( tau::Pill& pill ) 
+        {
+            auto header = Value::header( pill );
+            if ( !header )
+            {
+                return NULL;
+            }
+            
+            pill.move( sizeof( Header ) );
+            Decoder decoder( pill, header->version, header->size );
+            auto value = create( decoder );
+            pill.setOffset( 0 );
+            
+            if ( decoder.failed() && value )
+            {
+                value->destroy();
+                value = NULL;
+            }
+            
+            return value;
+        }
+        
+        bool Value::load( tau::Pill& pill, const State& lua )
+        {
+            auto header = Value::header( pill );
+            if ( !header )
+            {
+                return false;
+            }
+            
+            pill.move( sizeof( Header ) );
+            Decoder decoder( pill, header->version, header->size );
+            decoder.push( lua );
+            pill.setOffset( 0 );
+            
+            if ( decoder.failed() )
+            {
+                lua.pop( 1 );
+                return false;
+            }
+            
+            return true;
+        }
+        
+        Function::~Function( )
+        {
+            cleanup();
+        }
+        
+        void Function::cleanup()
+        {
+            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
+            {
+                if ( *i )
+                {
+                    ( *i )->destroy();
+                }
+            }
+            
+            m_upvalues.clear();
+            m_script = NULL;
+            m_reference = 0;
+            m_buffer.clear();
+        }
+        
+        Table::~Table( )
+        {
+            cleanup();
+        }
+
+        void Function::push( const State& lua ) const
+        {
+            if ( m_reference )
+            {
+                lua.pushReference( m_reference );
+                return;
+            }
+            
+            if ( m_script )
+            {
+                lua.load( *m_script );
+                return;
+            }
+            
+
+            lua.grow([ & ] ( ) { lua_load( lua, readerStatic, ( void* ) this, "" ); } );
+            
+            assert( lua_isfunction( lua, -1 ) );
+            unsigned int count = 1;
+            
+            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
+            {
+                //
+                //  upvalues that could not be dumped are left nil
+                //
+                if ( *i )
+                {
+                    ( *i )->push( lua );
+                    lua_setupvalue( lua, -2, count );
+                }
+                
+                count++;
+            }
+        }
+
+        void String::init( Decoder& decoder, char tag )
+        {
+            m_value = decoder.string( tag );
+        }
+
+        void String::data( Encoder& encoder ) const
+        {            
+            encoder.string( m_value );
+        }
+
+        void Simple::init( Decoder& decoder, char tag )
+        {
+            m_value = decoder.number( tag );
+        }
+        
+        void Simple::data( Encoder& encoder ) const
+        {
+            if ( Value::type() == LUA_TBOOLEAN )
+            {
+                encoder.boolean( m_value );
+                return;
+            }
+            
+            encoder.number( m_value );
+        }
+        
+        void Function::data( Encoder& encoder ) const
+        {
+            encoder.tag( Tag::Function );
+            encoder.bytes( m_buffer.data(), m_buffer.size( ) );
+            encoder.varint( m_upvalues.size() );
+                    
+            for ( auto i = m_upvalues.begin( ); i != m_upvalues.end( ); i++ )
+            {
+                auto value = *i;
+                if ( value )
+                {
+                    value->dump( encoder );
+                }
+                else
+                {
+                    encoder.nil();
+                }
+            }
+        }
+
+        void Function::init( Decoder& decoder, char tag )
+        {
+            if ( decoder.version() >= 2 && tag == Tag::Cached )
+            {
+                if ( decoder.has( PROTOTYPES_KEY_SIZE ) )
+                {
+                    auto code = Prototypes::code( std::string( decoder.contents(), PROTOTYPES_KEY_SIZE ) );
+                    decoder.move( PROTOTYPES_KEY_SIZE );
+                    
+                    if ( code )
+                    {
+                        m_buffer.add( code->data(), code->size() );
+                    }
+                }
+            }
+            else
+            {
+                auto size = decoder.length();
+                if ( decoder.has( size ) )
+                {
+                    m_buffer.add( decoder.contents(), size );
+                    decoder.move( size );
+                }
+            }
+            
+            auto upvalues = decoder.length();
+            while( m_upvalues.size() < upvalues && !decoder.failed() )
+            {
+                m_upvalues.push_back( Value::create( decoder ) );
+            }
+        }
+
+        void Function::init( const State& lua, int index, Visited& visited )
+        {
+            if ( lua_iscfunction( lua, index ) || !lua_isfunction( lua, index ) )
+            {
+                throw Exception( "cannot load function" );
+            }
+            
+            if ( index != -1 )
+            {
+                lua.pushvalue( index );
+            }
+                
+            lua_dump( lua, writerStatic, ( void* ) this );
+            
+            if ( index != -1 )
+            {
+                lua.pop( 1 );
+            }
+
+            unsigned int counter = 1;
+            while ( true )
+            {
+                const char* name = lua_getupvalue( lua, index, counter );
+                if ( !name )
+                {
+                    break;
+                }
+                
+                //
+                //  keep the upvalue position even if it was not loaded
+                //
+                m_upvalues.push_back( load( lua, -1, visited ) );
+                lua.pop( 1 );
+                counter ++;
+            }
+        }
+
+        bool Function::operator==( const Value& value ) const
+        {
+            const Function& function = dynamic_cast < const Function& > ( value );
+            if ( m_buffer == function.m_buffer && m_upvalues.size() == function.m_upvalues.size() )
+            {
+                for ( int i = 0; i < m_upvalues.size(); i++ )
+                {
+                    auto left = m_upvalues[ i ];
+                    auto right = function.m_upvalues[ i ];
+                    
+                    if ( !left || !right )
+                    {
+                        if ( left != right )
+                        {
+                            return false;
+                        }
+                        
+                        continue;
+                    }
+                    
+                    if ( !( *left == *right ) )
+                    {
+                        return false;
+                    }
+                }
+                
+                return true;
+            }
+
+            return false;
+        }
+
+        Value* Value::load( const State& lua, int index, bool pop, Visited::Shared shared )
+        {
+            Visited visited( shared );
+            auto value = load( lua, index, visited );
+            
+            if ( value && visited.failed() )
+            {
+                value->destroy();
+                value = NULL;
+            }
+            
+            if ( pop )
+            {
+                lua.pop( 1 );
+            }
+            
+            return value;
+        }
+        
+        Value* Value::load( const State& lua, int index, Visited& visited, bool copy )
+        {
+            unsigned int type = lua_type( lua, index );
+            const void* pointer = NULL;
+            
+            if ( type == LUA_TTABLE || type == LUA_TFUNCTION )
+            {
+                pointer = lua_topointer( lua, index );
+                auto mark = visited.mark( pointer );
+                
+                //
+                //  a value still being loaded is an ancestor, a cycle is cut
+                //
+                if ( mark == Visited::Open )
+                {
+                    return NULL;
+                }
+                
+                if ( mark == Visited::Closed && !copy && visited.shared() != Visited::Copy )
+                {
+                    if ( visited.shared() == Visited::Fail )
+                    {
+                        visited.fail();
+                    }
+                    
+                    return NULL;
+                }
+                
+                if ( !visited.open( pointer ) )
+                {
+                    return NULL;
+                }
+            }
+            
+            auto value = dynamic_cast< Value* >( tau::grain( type ) );
+                        
+            try
+            {
+                if ( !value )
+                {
+                    throw Exception();
+                }
+
+                value->setType(  type );
+                value->init( lua, index, visited );
+                
+            }
+            catch( const Exception& )
+            {
+                
+                if ( value )
+                {
+                    delete value;
+                }
+                
+                value = NULL;
+            }
+            
+            if ( pointer )
+            {
+                visited.close( pointer );
+            }
+            
+            return value;
+        }
+        
+        Visited::Mark Visited::mark( const void* pointer ) const
+        {
+            if ( !m_count )
+            {
+                return None;
+            }
+            
+            return m_entries[ slot( pointer ) ].mark;
+        }
+        
+        void Visited::set( const void* pointer, Mark mark )
+        {
+            if ( ( m_count + 1 ) * 2 > m_entries.size() )
+            {
+                std::vector< Entry > entries( std::max< size_t >( 16, m_entries.size() * 2 ) );
+                entries.swap( m_entries );
+                
+                for ( auto i = entries.begin(); i != entries.end(); i++ )
+                {
+                    if ( i->pointer )
+                    {
+                        m_entries[ slot( i->pointer ) ] = *i;
+                    }
+                }
+            }
+            
+            auto& entry = m_entries[ slot( pointer ) ];
+            if ( !entry.pointer )
+            {
+                entry.pointer = pointer;
+                m_count++;
+            }
+            
+            entry.mark = mark;
+        }
+        
+        //
+        //  slot of the pointer or the free one where it would go, linear probing
+        //
+        unsigned int Visited::slot( const void* pointer ) const
+        {
+            auto mask = m_entries.size() - 1;
+            auto i = ( ( ( uintptr_t ) pointer >> 3 ) * 0x9e3779b97f4a7c15UL >> 32 ) & mask;
+            
+            while ( m_entries[ i ].pointer && m_entries[ i ].pointer != pointer )
+            {
+                i = ( i + 1 ) & mask;
+            }
+            
+            return i;
+        }
+
+        std::unordered_map< std::string, std::string > Prototypes::s_codes;
+        tau::si::Lock Prototypes::s_lock;
+        
+        bool Prototypes::key( const State& lua, int index, std::string& key )
+        {
+            if ( index < 0 )
+            {
+                index = lua_gettop( lua ) + index + 1;
+            }
+            
+            registry( lua, "vega.prototypes.keys", "k" );
+            
+            lua_pushvalue( lua, index );
+            lua_rawget( lua, -2 );
+            
+            if ( lua_type( lua, -1 ) == LUA_TSTRING )
+            {
+                size_t length = 0;
+                auto data = lua_tolstring( lua, -1, &length );
+                key.assign( data, length );
+                
+                lua.pop( 2 );
+                return true;
+            }
+            
+            //
+            //  functions left out once the cache was full are not dumped again to find out
+            //
+            if ( lua_type( lua, -1 ) == LUA_TBOOLEAN )
+            {
+                lua.pop( 2 );
+                return false;
+            }
+            
+            lua.pop( 1 );
+            
+            std::string code;
+            lua.pushvalue( index );
+            lua_dump( lua, writer, &code );
+            lua.pop( 1 );
+            
+            key = Digest::of( code.data(), code.size() ).raw();
+            bool cached = true;
+            
+            {
+                tau::si::Gate gate( s_lock );
+                
+                auto found = s_codes.find( key );
+                if ( found == s_codes.end() )
+                {
+                    cached = s_codes.size() < PROTOTYPES_MAX;
+                    if ( cached )
+                    {
+                        s_codes[ key ].swap( code );
+                    }
+                }
+                else
+                {
+                    cached = found->second == code;
+                }
+            }
+            
+            lua_pushvalue( lua, index );
+            if ( cached )
+            {
+                lua_pushlstring( lua, key.data(), key.size() );
+            }
+            else
+            {
+                lua_pushboolean( lua, 0 );
+            }
+            
+            lua_rawset( lua, -3 );
+            
+            lua.pop( 1 );
+            return cached;
+        }
+        
+        bool Prototypes::push( const State& lua, const std::string& key )
+        {
+            auto code = Prototypes::code( key );
+            if ( !code )
+            {
+                return false;
+            }
+            
+            lua_checkstack( lua, 1 );
+            if ( luaL_loadbuffer( lua, code->data(), code->size(), "" ) )
+            {
+                lua.pop( 1 );
+                return false;
+            }
+            
+            return true;
+        }
+        
+        const std::string* Prototypes::code( const std::string& key )
+        {
+            tau::si::Gate gate( s_lock );
+            
+            auto found = s_codes.find( key );
+            return found == s_codes.end() ? NULL : &found->second;
+        }
+        
+        unsigned int Prototypes::size( )
+        {
+            tau::si::Gate gate( s_lock );
+            return s_codes.size();
+        }
+        
+        int Prototypes::writer( lua_State* lua, const void* data, size_t size, void* code )
+        {
+            static_cast< std::string* >( code )->append( ( const char* ) data, size );
+            return 0;
+        }
+        
+        //
+        //  pushes a table of the line kept in the registry, created on first use
+        //
+        void Prototypes::registry( const State& lua, const char* name, const char* mode )
+        {
+            lua_checkstack( lua, 4 );
+            lua_getfield( lua, LUA_REGISTRYINDEX, name );
+            
+            if ( lua_istable( lua, -1 ) )
+            {
+                return;
+            }
+            
+            lua.pop( 1 );
+            lua_newtable( lua );
+            
+            if ( mode )
+            {
+                lua_newtable( lua );
+                lua_pushstring( lua, mode );
+                lua_setfield( lua, -2, "__mode" );
+                lua_setmetatable( lua, -2 );
+            }
+            
+            lua_pushvalue( lua, -1 );
+            lua_setfield( lua, LUA_REGISTRYINDEX, name );
+        }
+        
+        bool Digest::take( const State& lua, int index, Digest& digest, Visited::Shared shared )
+        {
+            Visited visited( shared );
+            return value( lua, index, visited, digest ) && !visited.failed();
+        }
+        
+        std::string Digest::tostring( ) const
+        {
+            char buffer[ 33 ];
+            ::snprintf( buffer, sizeof( buffer ), "%016lx%016lx", m_high, m_low );
+            return std::string( buffer );
+        }
+        
+        void Digest::mix( unsigned long value )
+        {
+            m_high = avalanche( ( m_high ^ value ) * 0x87c37b91114253d5UL );
+            m_low = avalanche( ( m_low + value ) * 0x4cf5ad432745937fUL );
+        }
+        
+        void Digest::bytes( const char* data, unsigned long length )
+        {
+            mix( length );
+            
+            unsigned long word = 0;
+            for ( ; length >= sizeof( word ); data += sizeof( word ), length -= sizeof( word ) )
+            {
+                memcpy( &word, data, sizeof( word ) );
+                mix( word );
+            }
+            
+            if ( length )
+            {
+                word = 0;
+                memcpy( &word, data, length );
+                mix( word );
+            }
+        }
+        
+        //
+        //  values are visited as Value::load visits them, what it would leave out is left out here
+        //
+        bool Digest::value( const State& lua, int index, Visited& visited, Digest& digest, bool copy )
+        {
+            if ( index < 0 )
+            {
+                index = lua_gettop( lua ) + index + 1;
+            }
+            
+            auto type = lua_type( lua, index );
+            digest.mix( type );
+            
+            switch ( type )
+            {
+                case LUA_TBOOLEAN:
+                    digest.mix( lua_toboolean( lua, index ) );
+                    return true;
+                    
+                case LUA_TNUMBER:
+                {
+                    //
+                    //  -0 and 0 are equal numbers
+                    //
+                    double number = lua_tonumber( lua, index );
+                    unsigned long bits = 0;
+                    
+                    if ( number )
+                    {
+                        memcpy( &bits, &number, sizeof( bits ) );
+                    }
+                    
+                    digest.mix( bits );
+                    return true;
+                }
+                    
+                case LUA_TSTRING:
+                {
+                    size_t length = 0;
+                    auto data = lua_tolstring( lua, index, &length );
+                    digest.bytes( data, length );
+                    return true;
+                }
+                    
+                case LUA_TTABLE:
+                case LUA_TFUNCTION:
+                    break;
+                    
+                default:
+                    return false;
+            }
+            
+            auto pointer = lua_topointer( lua, index );
+            auto mark = visited.mark( pointer );
+            
+            if ( mark == Visited::Open )
+            {
+                return false;
+            }
+            
+            if ( mark == Visited::Closed && !copy && visited.shared() != Visited::Copy )
+            {
+                if ( visited.shared() == Visited::Fail )
+                {
+                    visited.fail();
+                }
+                
+                return false;
+            }
+            
+            if ( !visited.open( pointer ) )
+            {
+                return false;
+            }
+            
+            bool taken = type == LUA_TTABLE ? digest.table( lua, index, visited ) : digest.function( lua, index, visited );
+            
+            visited.close( pointer );
+            return taken;
+        }
+        
+        //
+        //  pairs are summed so the order of traversal does not matter, 
+        //  the metatable goes first as in Table::init
+        //
+        bool Digest::table( const State& lua, int index, Visited& visited )
+        {
+            Digest mt;
+            
+            if ( lua_getmetatable( lua, index ) )
+            {
+                if ( !value( lua, -1, visited, mt, true ) )
+                {
+                    mt = Digest();
+                }
+                
+                lua.pop( 1 );
+            }
+            
+            Digest pairs;
+            unsigned long count = 0;
+            
+            lua_checkstack( lua, 2 );
+            lua_pushnil( lua );
+            
+            while ( lua_next( lua, index ) != 0 )
+            {
+                Digest key;
+                Digest value;
+                
+                if ( Digest::value( lua, -1, visited, value ) && Digest::value( lua, -2, visited, key ) )
+                {
+                    Digest pair;
+                    pair.mix( key );
+                    pair.mix( value );
+                    
+                    pairs.add( pair );
+                    count++;
+                }
+                
+                lua.pop( 1 );
+            }
+            
+            mix( count );
+            mix( pairs );
+            mix( mt );
+            return true;
+        }
+        
+        bool Digest::function( const State& lua, int index, Visited& visited )
+        {
+            if ( lua_iscfunction( lua, index ) )
+            {
+                return false;
+            }
+            
+            lua.pushvalue( index );
+            lua_dump( lua, writer, this );
+            lua.pop( 1 );
+            
+            for ( unsigned int i = 1; ; i++ )
+            {
+                lua_checkstack( lua, 1 );
+                if ( !lua_getupvalue( lua, index, i ) )
+                {
+                    break;
+                }
+                
+                //
+                //  upvalues left out count as nil ones
+                //
+                Digest upvalue;
+                if ( !value( lua, -1, visited, upvalue ) )
+                {
+                    upvalue = Digest();
+                }
+                
+                mix( upvalue );
+                lua.pop( 1 );
+            }
+            
+            return true;
+        }
+        
+        int Digest::writer( lua_State* lua, const void* data, size_t size, void* digest )
+        {
+            static_cast< Digest* >( digest )->bytes( ( const char* ) data, size );
+            return 0;
+        }
+        
+        int Function::writerStatic( lua_State *lua, const void* buffer, size_t size, void* data )
+        {
+            return( reinterpret_cast < Function* > ( data ) )->writer( buffer, size );
+        }
+
+        int Function::writer( const void* data, size_t size )
+        {
+            m_buffer.add( ( const char* ) data, size );
+            return 0;
+        }
+
+        const char* Function::readerStatic( lua_State* lua, void* data, size_t* size )
+        {
+            return( reinterpret_cast < Function* > ( data ) )->reader( size );
+        }
+
+        const char* Function::reader( size_t* size )
+        {
+            *size = m_buffer.length( );
+            const char* data = m_buffer.data( );
+            m_buffer.clear( );
+            return data;
+        }
+        
+        void Table::set( const std::string& key, Value* value )
+        {
+            insert( Item( String::get( key ) ), Item( value ) );
+        }
+        
+        void Table::cleanup()
+        {
+            for ( auto i = m_array.begin( ); i != m_array.end( ); i++ )
+            {
+                i->destroy();
+            }
+            
+            for ( auto i = m_hash.begin( ); i != m_hash.end( ); i++ )
+            {
+                i->key.destroy();
+                i->value.destroy();
+                *i = Entry();
+            }
+            
+            m_array.clear();
+            m_count = 0;
+
+            if ( m_mt )
+            {
+                m_mt->destroy();
+                m_mt = NULL;
+            }
+        }
+        
+        void Table::push( const State& lua ) const
+        {
+            lua.grow( [ & ]( ) { lua_createtable( lua, m_array.size(), m_count ); } );
+            
+            for ( unsigned int i = 0; i < m_array.size(); i++ )
+            {
+                m_array[ i ].push( lua );
+                lua_rawseti( lua, -2, i + 1 );
+            }
+
+            for ( auto i = m_hash.begin( ); i != m_hash.end( ); i++ )
+            {
+                if ( i->key.type != LUA_TNIL )
+                {
+                    i->key.push( lua );
+                    i->value.push( lua );
+                    lua_rawset( lua, -3 );
+                }
+            }
+
+            if ( m_mt )
+            {
+                m_mt->push( lua );
+                lua_setmetatable( lua, -2 );
+            }
+        }
+        
+        //
+        //  the array part goes first as plain values, then the pairs of the hash part
+        //
+        void Table::data( Encoder& encoder ) const
+        {
+            encoder.tag( Tag::Table );
+            encoder.varint( m_array.size( ) );
+            
+            for ( auto i = m_array.begin( ); i != m_array.end( ); i++ )
+            {
+                i->dump( encoder );
+            }
+            
+            encoder.varint( m_count );
+            
+            for ( auto i = m_hash.begin( ); i != m_hash.end( ); i++ )
+            {
+                if ( i->key.type != LUA_TNIL )
+                {
+                    i->key.dump( encoder );
+                    i->value.dump( encoder );
+                }
+            }
+            
+            if ( m_mt )
+            {
+                m_mt->dump( encoder );
+            }
+            else
+            {
+                encoder.nil();
+            }
+        }
+
+        //
+        //  version 1 tables have only pairs
+        //
+        void Table::init( Decoder& decoder, char tag )
+        {
+            if ( decoder.version() >= 3 && ( tag == Tag::Shape || tag == Tag::Shaped ) )
+            {
+                auto shape = decoder.shape( tag );
+                auto size = shape ? shape->size() : 0;
+                
+                rehash( size );
+                for ( unsigned int i = 0; i < size && !decoder.failed(); i++ )
+                {
+                    //
+                    //  fields the record did not have are written as nil
+                    //
+                    Item value;
+                    if ( value.load( decoder ) )
+                    {
+                        insert( Item( String::get( ( *shape )[ i ] ) ), value );
+                    }
+                }
+                
+                m_mt = dynamic_cast< Table* >( Value::create( decoder ) );
+                return;
+            }
+            
+            if ( decoder.version() >= 2 )
+            {
+                auto size = decoder.varint();
+                
+                //
+                //  every item takes at least a byte
+                //
+                m_array.reserve( std::min( size, decoder.remaining() ) );
+                for ( unsigned long i = 0; i < size; i++ )
+                {
+                    Item item;
+                    if ( !item.load( decoder ) )
+                    {
+                        assert( decoder.failed() );
+                        break;
+                    }
+                    
+                    m_array.push_back( item );
+                }
+            }
+            
+            auto count = decoder.length();
+            
+            rehash( std::min( count, decoder.remaining() ) );
+            for ( unsigned long i = 0; i < count; i++ )
+            {
+                Item key;
+                Item value;
+                
+                if ( !key.load( decoder ) || !value.load( decoder ) )
+                {
+                    assert( decoder.failed() );
+                    key.destroy();
+                    break;
+                }
+                
+                insert( key, value );
+            }
+            
+            m_mt = dynamic_cast< Table* >( Value::create( decoder ) );
+        }
+
+        void Table::init( const State& lua, int index, Visited& visited )
+        {
+            if ( lua_getmetatable( lua, index ) )
+            {
+                m_mt = dynamic_cast < Table* > ( load( lua, -1, visited, true ) );
+                lua.pop( 1 );
+            }
+            
+            m_array.reserve( lua_objlen( lua, index ) );
+            lua_pushnil( lua );
+
+            while ( lua_next( lua, index - 1 ) != 0 )
+            {
+                Item value;
+                Item key;
+                
+                if ( value.load( lua, -1, visited ) && key.load( lua, -2, visited ) )
+                {
+                    insert( key, value );
+                }
+                else
+                {
+                    value.destroy();
+                }
+                
+                lua.pop( 1 );
+            }
+        }
+
+        bool Table::operator==( const Value& value ) const
+        {
+            const Table& table = dynamic_cast < const Table& > ( value );
+            
+            if ( size( ) != table.size( ) )
+            {
+                return false;
+            }
+            
+            for ( unsigned int i = 0; i < m_array.size(); i++ )
+            {
+                Item key;
+                key.type = LUA_TNUMBER;
+                key.number = i + 1;
+                
+                auto found = table.find( key );
+                if ( !found || !m_array[ i ].same( *found ) )
+                {
+                    return false;
+                }
+            }
+
+            for ( auto i = m_hash.begin( ); i != m_hash.end( ); i++ )
+            {
+                if ( i->key.type == LUA_TNIL )
+                {
+                    continue;
+                }
+                
+                auto found = table.find( i->key );
+                if ( !found || !i->value.same( *found ) )
+                {
+                    return false;
+                }
+            }
+            
+            if ( m_mt )
+            {
+                if ( !table.m_mt )
+                {
+                    return false;
+                }
+                else
+                {
+                    return *m_mt == *table.m_mt;
+                }
+            }
+            
+            return true;
+        }
+        
+        long Table::position( const Item& key ) const
+        {
+            if ( key.type != LUA_TNUMBER || key.number < 1 || key.number != ( unsigned long ) key.number )
+            {
+                return -1;
+            }
+            
+            return ( unsigned long ) key.number - 1;
+        }
+        
+        //
+        //  the key takes ownership of the items, replacing the value of an existing key
+        //
+        void Table::insert( const Item& key, const Item& value )
+        {
+            auto position = this->position( key );
+            
+            if ( position >= 0 && position < m_array.size() )
+            {
+                m_array[ position ].destroy();
+                m_array[ position ] = value;
+                return;
+            }
+            
+            if ( position >= 0 && position == m_array.size() && !find( key ) )
+            {
+                m_array.push_back( value );
+                return;
+            }
+            
+            if ( ( m_count + 1 ) * 4 > m_hash.size() * 3 )
+            {
+                rehash( ( m_count + 1 ) * 2 );
+            }
+            
+            auto hash = key.hash();
+            auto mask = m_hash.size() - 1;
+            auto i = hash & mask;
+            
+            for ( ; m_hash[ i ].key.type != LUA_TNIL; i = ( i + 1 ) & mask )
+            {
+                auto& entry = m_hash[ i ];
+                if ( entry.hash == hash && entry.key.equals( key ) )
+                {
+                    Item( key ).destroy();
+                    entry.value.destroy();
+                    entry.value = value;
+                    return;
+                }
+            }
+            
+            auto& entry = m_hash[ i ];
+            entry.key = key;
+            entry.value = value;
+            entry.hash = hash;
+            m_count++;
+        }
+        
+        const Table::Item* Table::find( const Item& key ) const
+        {
+            auto position = this->position( key );
+            if ( position >= 0 && position < m_array.size() )
+            {
+                return &m_array[ position ];
+            }
+            
+            if ( !m_count )
+            {
+                return NULL;
+            }
+            
+            auto hash = key.hash();
+            auto mask = m_hash.size() - 1;
+            
+            for ( auto i = hash & mask; m_hash[ i ].key.type != LUA_TNIL; i = ( i + 1 ) & mask )
+            {
+                auto& entry = m_hash[ i ];
+                if ( entry.hash == hash && entry.key.equals( key ) )
+                {
+                    return &entry.value;
+                }
+            }
+            
+            return NULL;
+        }
+        
+        //
+        //  open addressing with linear probing, capacity is kept a power of 2
+        //
+        void Table::rehash( unsigned int count )
+        {
+            if ( !count )
+            {
+                return;
+            }
+            
+            unsigned int capacity = 8;
+            while ( capacity * 3 < count * 4 )
+            {
+                capacity *= 2;
+            }
+            
+            if ( capacity <= m_hash.size() )
+            {
+                return;
+            }
+            
+            Hash hash( capacity );
+            auto mask = capacity - 1;
+            
+            for ( auto i = m_hash.begin( ); i != m_hash.end( ); i++ )
+            {
+                if ( i->key.type == LUA_TNIL )
+                {
+                    continue;
+                }
+                
+                auto j = i->hash & mask;
+                while ( hash[ j ].key.type != LUA_TNIL )
+                {
+                    j = ( j + 1 ) & mask;
+                }
+                
+                hash[ j ] = *i;
+            }
+            
+            m_hash.swap( hash );
+        }
+        
+        //
+        //  values of two tables are the same if they have equal contents
+        //
+        bool Table::Item::same( const Item& item ) const
+        {
+            if ( type != item.type )
+            {
+                return false;
+            }
+            
+            if ( inlined() )
+            {
+                return number == item.number;
+            }
+            
+            return value && item.value && *value == *item.value;
+        }
+        
+        //
+        //  keys are equal if they would index the same slot of a lua table
+        //
+        bool Table::Item::equals( const Item& item ) const
+        {
+            if ( type != item.type )
+            {
+                return false;
+            }
+            
+            if ( inlined() )
+            {
+                return number == item.number;
+            }
+            
+            if ( type == LUA_TSTRING )
+            {
+                return static_cast< const String* >( value )->value() == static_cast< const String* >( item.value )->value();
+            }
+            
+            return value == item.value;
+        }
+        
+        unsigned int Table::Item::hash( ) const
+        {
+            if ( inlined() )
+            {
+                return std::hash< double >()( number ? number : 0 ) ^ type;
+            }
+            
+            if ( type == LUA_TSTRING )
+            {
+                return std::hash< std::string >()( static_cast< const String* >( value )->value() );
+            }
+            
+            return std::hash< const void* >()( value );
+        }
+        
+        void Table::Item::push( const State& lua ) const
+        {
+            switch ( type )
+            {
+                case LUA_TBOOLEAN:
+                    lua.push( ( bool ) number );
+                    break;
+                    
+                case LUA_TNUMBER:
+                    lua.grow( [ & ]( ) { lua_pushnumber( lua, number ); } );
+                    break;
+                    
+                default:
+                    value->push( lua );
+            }
+        }
+        
+        //
+        //  inline items are written the same way as Simple values
+        //
+        void Table::Item::dump( Encoder& encoder ) const
+        {
+            switch ( type )
+            {
+                case LUA_TBOOLEAN:
+                    encoder.boolean( number );
+                    break;
+                    
+                case LUA_TNUMBER:
+                    encoder.number( number );
+                    break;
+                    
+                default:
+                    value->dump( encoder );
+            }
+        }
+        
+        bool Table::Item::load( Decoder& decoder )
+        {
+            auto tag = decoder.tag();
+            type = decoder.type( tag );
+            
+            if ( inlined() )
+            {
+                number = decoder.number( tag );
+                return true;
+            }
+            
+            value = Value::create( decoder, tag );
+            type = value ? value->type() : LUA_TNIL;
+            return value;
+        }
+        
+        bool Table::Item::load( const State& lua, int index, Visited& visited )
+        {
+            type = lua_type( lua, index );
+            
+            switch ( type )
+            {
+                case LUA_TBOOLEAN:
+                    number = lua_toboolean( lua, index );
+                    return true;
+                    
+                case LUA_TNUMBER:
+                    number = lua_tonumber( lua, index );
+                    return true;
+                    
+                default:
+                    value = Value::load( lua, index, visited );
+                    type = value ? value->type() : LUA_TNIL;
+                    return value;
+            }
+        }
+        
+        void Table::Item::destroy( )
+        {
+            if ( !inlined() && value )
+            {
+                value->destroy();
+            }
+            
+            type = LUA_TNIL;
+            value = NULL;
+        }
+        
+        Stream::Stream( )
+        : m_version( 0 ), m_failed( false ), m_target( NULL )
+        {
+            static_assert( sizeof( types::Value::Header ) <= sizeof( m_buffer ), "header does not fit" );
+            expect( Header, Any, sizeof( types::Value::Header ) );
+        }
+        
+        Stream::~Stream( )
+        {
+            clear();
+        }
+        
+        void Stream::clear( )
+        {
+            if ( m_target )
+            {
+                m_target->destroy();
+                m_target = NULL;
+            }
+            
+            for ( auto i = m_frames.begin(); i != m_frames.end(); i++ )
+            {
+                if ( i->keyed )
+                {
+                    i->key.destroy();
+                }
+                
+                i->value->destroy();
+            }
+            
+            for ( auto i = m_values.begin(); i != m_values.end(); i++ )
+            {
+                if ( *i )
+                {
+                    ( *i )->destroy();
+                }
+            }
+            
+            m_frames.clear();
+            m_strings.clear();
+            m_shapes.clear();
+            m_values.clear();
+            m_failed = false;
+            expect( Header, Any, sizeof( types::Value::Header ) );
+        }
+        
+        bool Stream::read( Value*& value )
+        {
+            if ( m_values.empty() )
+            {
+                return false;
+            }
+            
+            value = m_values.front();
+            m_values.pop_front();
+            return true;
+        }
+        
+        //
+        //  bytes go into the pending token, the token is handled as soon as it is whole
+        //
+        bool Stream::write( const char* data, unsigned long length )
+        {
+            while ( length && !m_failed )
+            {
+                bool ok = true;
+                
+                switch ( m_token )
+                {
+                    case Header:
+                    case Fixed:
+                    {
+                        auto size = std::min( m_size - m_filled, length );
+                        memcpy( m_buffer + m_filled, data, size );
+                        m_filled += size;
+                        data += size;
+                        length -= size;
+                        
+                        if ( m_filled == m_size )
+                        {
+                            ok = m_token == Header ? header() : fixed();
+                        }
+                        
+                        break;
+                    }
+                    
+                    case Tag:
+                        ok = tag( *data );
+                        data++;
+                        length--;
+                        break;
+                        
+                    case Varint:
+                    {
+                        auto byte = ( unsigned char ) *data;
+                        data++;
+                        length--;
+                        
+                        m_integer |= ( unsigned long ) ( byte & 0x7f ) << m_shift;
+                        m_shift += 7;
+                        
+                        if ( !( byte & 0x80 ) || m_shift >= 64 )
+                        {
+                            ok = integer( m_integer );
+                        }
+                        
+                        break;
+                    }
+                    
+                    case Bytes:
+                    {
+                        auto size = std::min( m_size - m_filled, length );
+                        if ( m_use == StringBytes )
+                        {
+                            m_target->m_value.append( data, size );
+                        }
+                        else
+                        {
+                            static_cast< Function* >( m_frames.back().value )->m_buffer.add( data, size );
+                        }
+                        
+                        m_filled += size;
+                        data += size;
+                        length -= size;
+                        
+                        if ( m_filled == m_size )
+                        {
+                            ok = bytes();
+                        }
+                        
+                        break;
+                    }
+                }
+                
+                m_failed = !ok;
+            }
+            
+            return !m_failed;
+        }
+        
+        void Stream::expect( Token token, Use use, unsigned long size )
+        {
+            m_token = token;
+            m_use = use;
+            m_size = size;
+            m_filled = 0;
+            m_integer = 0;
+            m_shift = 0;
+        }
+        
+        //
+        //  length fields, 4 bytes in version 1
+        //
+        void Stream::length( Use use )
+        {
+            if ( m_version >= 2 )
+            {
+                expect( Varint, use );
+            }
+            else
+            {
+                expect( Fixed, use, sizeof( unsigned int ) );
+            }
+        }
+        
+        //
+        //  every value starts a new string table, as the encoder does
+        //
+        bool Stream::header( )
+        {
+            auto header = ( types::Value::Header* ) m_buffer;
+            if ( !header->version || header->version > TYPES_VERSION )
+            {
+                return false;
+            }
+            
+            m_version = header->version;
+            m_strings.clear();
+            m_shapes.clear();
+            expect( Tag, Any );
+            return true;
+        }
+        
+        bool Stream::tag( char tag )
+        {
+            Table::Item item;
+            
+            if ( m_version < 2 )
+            {
+                switch ( tag )
+                {
+                    case LUA_TNIL:
+                        return complete( item );
+                        
+                    case LUA_TBOOLEAN:
+                        expect( Fixed, Boolean, sizeof( long ) );
+                        return true;
+                        
+                    case LUA_TNUMBER:
+                        expect( Fixed, Long, sizeof( long ) );
+                        return true;
+                        
+                    case LUA_TSTRING:
+                    case LUA_TFUNCTION:
+                    case LUA_TTABLE:
+                        break;
+                        
+                    default:
+                        return false;
+                }
+            }
+            else
+            {
+                if ( tag & types::Tag::Small )
+                {
+                    item.type = LUA_TNUMBER;
+                    item.number = ( unsigned char ) tag & ~types::Tag::Small;
+                    return complete( item );
+                }
+                
+                switch ( tag )
+                {
+                    case types::Tag::Nil:
+                        return complete( item );
+                        
+                    case types::Tag::False:
+                    case types::Tag::True:
+                        item.type = LUA_TBOOLEAN;
+                        item.number = tag == types::Tag::True;
+                        return complete( item );
+                        
+                    case types::Tag::Integer:
+                        expect( Varint, Integer );
+                        return true;
+                        
+                    case types::Tag::Double:
+                        expect( Fixed, Double, sizeof( double ) );
+                        return true;
+                        
+                    case types::Tag::Reference:
+                        expect( Varint, Reference );
+                        return true;
+                        
+                    case types::Tag::Shape:
+                    case types::Tag::Shaped:
+                    {
+                        if ( m_version < 3 )
+                        {
+                            return false;
+                        }
+                        
+                        auto table = Table::get();
+                        table->setType( LUA_TTABLE );
+                        
+                        if ( tag == types::Tag::Shape )
+                        {
+                            m_frames.push_back( Frame( table, Frame::Keys, 0 ) );
+                            expect( Varint, ShapeLength );
+                        }
+                        else
+                        {
+                            m_frames.push_back( Frame( table, Frame::Fields, 0 ) );
+                            expect( Varint, ShapeIndex );
+                        }
+                        
+                        return true;
+                    }
+                        
+                    case types::Tag::String:
+                    case types::Tag::Function:
+                    case types::Tag::Table:
+                        break;
+                        
+                    default:
+                        return false;
+                }
+            }
+            
+            switch ( Decoder::type( tag, m_version ) )
+            {
+                case LUA_TSTRING:
+                    m_target = String::get( std::string() );
+                    length( StringLength );
+                    break;
+                    
+                case LUA_TFUNCTION:
+                {
+                    auto function = Function::get();
+                    function->setType( LUA_TFUNCTION );
+                    m_frames.push_back( Frame( function, Frame::Closures, 0 ) );
+                    length( CodeLength );
+                    break;
+                }
+                    
+                case LUA_TTABLE:
+                {
+                    auto table = Table::get();
+                    table->setType( LUA_TTABLE );
+                    
+                    if ( m_version >= 2 )
+                    {
+                        m_frames.push_back( Frame( table, Frame::Array, 0 ) );
+                        expect( Varint, ArrayLength );
+                    }
+                    else
+                    {
+                        m_frames.push_back( Frame( table, Frame::Pairs, 0 ) );
+                        length( PairsLength );
+                    }
+                    
+                    break;
+                }
+            }
+            
+            return true;
+        }
+        
+        bool Stream::fixed( )
+        {
+            Table::Item item;
+            
+            switch ( m_use )
+            {
+                case Double:
+                    item.type = LUA_TNUMBER;
+                    memcpy( &item.number, m_buffer, sizeof( item.number ) );
+                    return complete( item );
+                    
+                case Long:
+                case Boolean:
+                {
+                    long number;
+                    memcpy( &number, m_buffer, sizeof( number ) );
+                    
+                    item.type = m_use == Long ? LUA_TNUMBER : LUA_TBOOLEAN;
+                    item.number = number;
+                    return complete( item );
+                }
+                    
+                default:
+                {
+                    unsigned int length;
+                    memcpy( &length, m_buffer, sizeof( length ) );
+                    return integer( length );
+                }
+            }
+        }
+        
+        bool Stream::integer( unsigned long value )
+        {
+            Table::Item item;
+            
+            switch ( m_use )
+            {
+                case Integer:
+                    item.type = LUA_TNUMBER;
+                    item.number = ( long ) ( value >> 1 ) ^ -( long ) ( value & 1 );
+                    return complete( item );
+                    
+                case Reference:
+                    item = Table::Item( String::get( value < m_strings.size() ? m_strings[ value ] : std::string() ) );
+                    return complete( item );
+                    
+                case StringLength:
+                    m_target->m_value.reserve( std::min< unsigned long >( value, STREAM_RESERVE_MAX ) );
+                    expect( Bytes, StringBytes, value );
+                    return value ? true : bytes();
+                    
+                case CodeLength:
+                    expect( Bytes, CodeBytes, value );
+                    return value ? true : bytes();
+                    
+                case Upvalues:
+                {
+                    auto& frame = m_frames.back();
+                    frame.left = value;
+                    
+                    if ( !value )
+                    {
+                        item = Table::Item( frame.value );
+                        m_frames.pop_back();
+                        return complete( item );
+                    }
+                    
+                    static_cast< Function* >( frame.value )->m_upvalues.reserve( std::min< unsigned long >( value, STREAM_RESERVE_MAX ) );
+                    expect( Tag, Any );
+                    return true;
+                }
+                    
+                case ArrayLength:
+                {
+                    auto& frame = m_frames.back();
+                    frame.left = value;
+                    
+                    if ( !value )
+                    {
+                        length( PairsLength );
+                        return true;
+                    }
+                    
+                    static_cast< Table* >( frame.value )->m_array.reserve( std::min< unsigned long >( value, STREAM_RESERVE_MAX ) );
+                    expect( Tag, Any );
+                    return true;
+                }
+                    
+                case PairsLength:
+                {
+                    auto& frame = m_frames.back();
+                    frame.phase = value ? Frame::Pairs : Frame::Meta;
+                    frame.left = value;
+                    
+                    static_cast< Table* >( frame.value )->rehash( std::min< unsigned long >( value, STREAM_RESERVE_MAX ) );
+                    expect( Tag, Any );
+                    return true;
+                }
+                    
+                case ShapeLength:
+                {
+                    //
+                    //  the encoder never writes bigger shapes
+                    //
+                    if ( value > TYPES_SHAPE_KEYS_MAX )
+                    {
+                        return false;
+                    }
+                    
+                    auto& frame = m_frames.back();
+                    frame.shape = m_shapes.size();
+                    frame.left = value;
+                    
+                    m_shapes.push_back( Decoder::Shape() );
+                    m_shapes.back().reserve( value );
+                    
+                    if ( !value )
+                    {
+                        frame.phase = Frame::Meta;
+                    }
+                    
+                    expect( Tag, Any );
+                    return true;
+                }
+                    
+                case ShapeIndex:
+                {
+                    if ( value >= m_shapes.size() )
+                    {
+                        return false;
+                    }
+                    
+                    auto& frame = m_frames.back();
+                    frame.shape = value;
+                    frame.left = m_shapes[ value ].size();
+                    frame.phase = frame.left ? Frame::Fields : Frame::Meta;
+                    
+                    static_cast< Table* >( frame.value )->rehash( frame.left );
+                    expect( Tag, Any );
+                    return true;
+                }
+                    
+                default:
+                    return false;
+            }
+        }
+        
+        bool Stream::bytes( )
+        {
+            if ( m_use == CodeBytes )
+            {
+                length( Upvalues );
+                return true;
+            }
+            
+            auto string = m_target;
+            m_target = NULL;
+            
+            auto size = string->m_value.size();
+            if ( m_version >= 2 && size >= TYPES_STRING_MIN && size <= TYPES_STRING_MAX && m_strings.size() < TYPES_STRINGS_MAX )
+            {
+                m_strings.push_back( string->m_value );
+            }
+            
+            return complete( Table::Item( string ) );
+        }
+        
+        //
+        //  hands a finished item to the value being built, values finishing their parents 
+        //  are handed up in turn until one is still open or the root is done
+        //
+        bool Stream::complete( Table::Item item )
+        {
+            while ( !m_frames.empty() )
+            {
+                auto& frame = m_frames.back();
+                
+                switch ( frame.phase )
+                {
+                    case Frame::Array:
+                    {
+                        if ( item.type == LUA_TNIL )
+                        {
+                            return false;
+                        }
+                        
+                        static_cast< Table* >( frame.value )->m_array.push_back( item );
+                        
+                        if ( --frame.left )
+                        {
+                            expect( Tag, Any );
+                        }
+                        else
+                        {
+                            length( PairsLength );
+                        }
+                        
+                        return true;
+                    }
+                        
+                    case Frame::Pairs:
+                    {
+                        if ( item.type == LUA_TNIL )
+                        {
+                            return false;
+                        }
+                        
+                        if ( !frame.keyed )
+                        {
+                            frame.key = item;
+                            frame.keyed = true;
+                        }
+                        else
+                        {
+                            static_cast< Table* >( frame.value )->insert( frame.key, item );
+                            frame.keyed = false;
+                            
+                            if ( !--frame.left )
+                            {
+                                frame.phase = Frame::Meta;
+                            }
+                        }
+                        
+                        expect( Tag, Any );
+                        return true;
+                    }
+                        
+                    case Frame::Keys:
+                    {
+                        if ( item.type != LUA_TSTRING )
+                        {
+                            item.destroy();
+                            return false;
+                        }
+                        
+                        auto& shape = m_shapes[ frame.shape ];
+                        shape.push_back( static_cast< String* >( item.value )->m_value );
+                        item.destroy();
+                        
+                        if ( !--frame.left )
+                        {
+                            frame.phase = Frame::Fields;
+                            frame.left = shape.size();
+                            static_cast< Table* >( frame.value )->rehash( frame.left );
+                        }
+                        
+                        expect( Tag, Any );
+                        return true;
+                    }
+                        
+                    //
+                    //  values come in the order of the keys of the shape, missing fields are nil
+                    //
+                    case Frame::Fields:
+                    {
+                        auto& shape = m_shapes[ frame.shape ];
+                        
+                        if ( item.type != LUA_TNIL )
+                        {
+                            auto key = Table::Item( String::get( shape[ shape.size() - frame.left ] ) );
+                            static_cast< Table* >( frame.value )->insert( key, item );
+                        }
+                        
+                        if ( !--frame.left )
+                        {
+                            frame.phase = Frame::Meta;
+                        }
+                        
+                        expect( Tag, Any );
+                        return true;
+                    }
+                        
+                    case Frame::Meta:
+                    {
+                        auto table = static_cast< Table* >( frame.value );
+                        
+                        if ( item.type == LUA_TTABLE )
+                        {
+                            table->m_mt = static_cast< Table* >( item.value );
+                        }
+                        else
+                        {
+                            item.destroy();
+                        }
+                        
+                        item = Table::Item( table );
+                        m_frames.pop_back();
+                        break;
+                    }
+                        
+                    case Frame::Closures:
+                    {
+                        auto function = static_cast< Function* >( frame.value );
+                        function->m_upvalues.push_back( value( item ) );
+                        
+                        if ( --frame.left )
+                        {
+                            expect( Tag, Any );
+                            return true;
+                        }
+                        
+                        item = Table::Item( function );
+                        m_frames.pop_back();
+                        break;
+                    }
+                }
+            }
+            
+            m_values.push_back( value( item ) );
+            expect( Header, Any, sizeof( types::Value::Header ) );
+            return true;
+        }
+        
+        //
+        //  inline items become Simple values, nil is NULL
+        //
+        types::Value* Stream::value( const Table::Item& item )
+        {
+            if ( !item.inlined() )
+            {
+                return item.value;
+            }
+            
+            auto simple = dynamic_cast< Simple* >( Simple::create() );
+            simple->setType( item.type );
+            simple->m_value = item.number;
+            return simple;
         }
      }
 }
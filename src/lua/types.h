@@ -3,6 +3,7 @@
 
 #include "state.h"
 #include <tau/common.h>
+#include <tau/si.h>
 
 
 namespace lua
@@ -14,10 +15,512 @@ namespace lua
     
     namespace types
     {        
+        class Value;
+        class Visited;
+        class Stream;
+        
+#define TYPES_VERSION 3
+#define TYPES_STRING_MIN 2
+#define TYPES_STRING_MAX 64
+#define TYPES_STRINGS_MAX 4096
+#define TYPES_SHAPE_KEYS_MAX 64
+#define TYPES_SHAPES_MAX 4096
+
+//
+//  nesting of tables and functions a value can have, deeper ones fail the dump or the load
+//  instead of running out of C stack
+//
+#define TYPES_DEPTH_MAX 200
+        
+        //
+        //  leading byte of every value in a dump, small integers 0..127 are the tag itself,
+        //  tables keyed only by strings are written as a shape, their keys once per dump, 
+        //  followed by the values in the order of the keys
+        //
+        struct Tag
+        {
+            enum
+            {
+                Nil = 0,
+                False,
+                True,
+                Integer,
+                Double,
+                String,
+                Reference,
+                Function,
+                Table,
+                Cached,
+                Shape,
+                Shaped,
+                Small = 0x80
+            };
+        };
+        
+        //
+        //  writes values with varint lengths, short strings written once are referred to by index,
+        //  bytes are kept until flush so counts of values written from the stack can be patched
+        //
+        class Encoder
+        {
+        public:
+            //
+            //  cached functions are written as the key of their code in Prototypes,
+            //  only for dumps read by the same process
+            //
+            Encoder( tau::Pill& pill, bool cached = false )
+            : m_pill( pill ), m_cached( cached )
+            {
+            }
+            
+            void tag( char tag )
+            {
+                m_data.push_back( tag );
+            }
+            
+            void varint( unsigned long value );
+            void bytes( const char* data, unsigned long length );
+            
+            void nil( )
+            {
+                tag( Tag::Nil );
+            }
+            
+            void boolean( bool value )
+            {
+                tag( value ? Tag::True : Tag::False );
+            }
+            
+            void number( double value );
+            void string( const char* data, unsigned long length );
+            void string( const std::string& value )
+            {
+                string( value.data(), value.size() );
+            }
+            
+            //
+            //  writes the value at index of the lua stack without loading it first,
+            //  false if nothing was written
+            //
+            bool value( const State& lua, int index, Visited& visited, bool copy = false );
+            
+            void flush( )
+            {
+                m_pill.add( m_data.data(), m_data.size() );
+                m_data.clear();
+            }
+            
+        private:
+            //
+            //  position to go back to when a pair cannot be written whole
+            //
+            struct Mark
+            {
+                unsigned long position;
+                unsigned int strings;
+                unsigned int shapes;
+            };
+            
+            Mark mark( ) const
+            {
+                Mark mark = { m_data.size(), ( unsigned int ) m_order.size(), ( unsigned int ) m_shapes.size() };
+                return mark;
+            }
+            
+            void rollback( const Mark& mark );
+            
+            //
+            //  one byte for a count written later, patch makes room if it needs more
+            //
+            unsigned long reserve( )
+            {
+                m_data.push_back( 0 );
+                return m_data.size() - 1;
+            }
+            
+            void patch( unsigned long position, unsigned long value );
+            
+            void table( const State& lua, int index, Visited& visited );
+            bool shaped( const State& lua, int index, Visited& visited );
+            void metatable( const State& lua, int index, Visited& visited );
+            bool function( const State& lua, int index, Visited& visited );
+            static int writer( lua_State* lua, const void* data, size_t size, void* code );
+            
+            //
+            //  keys are lua strings, which are interned, so their data pointers identify them
+            //  while the dump is written
+            //
+            struct Key
+            {
+                const char* data;
+                size_t length;
+            };
+            
+            struct Shape
+            {
+                std::vector< Key > keys;
+                std::vector< const char* > sorted;
+                unsigned long signature;
+            };
+            
+        private:
+            tau::Pill& m_pill;
+            std::string m_data;
+            std::string m_code;
+            std::unordered_map< std::string, unsigned int > m_strings;
+            std::vector< std::string > m_order;
+            bool m_cached;
+            
+            std::vector< Shape > m_shapes;
+            std::unordered_multimap< unsigned long, unsigned int > m_signatures;
+            std::vector< Key > m_keys;
+        };
+        
+        //
+        //  reads values of the current version and of version 1, which had fixed size fields
+        //
+        class Decoder
+        {
+        public:
+            //
+            //  reads stop at size bytes from the start of the pill, going past it fails the load
+            //
+            Decoder( tau::Pill& pill, unsigned int version, unsigned long size )
+            : m_pill( pill ), m_version( version ), m_end( pill.contents() + size ), m_failed( false ), m_depth( 0 )
+            {
+            }
+            
+            //
+            //  around tables and functions, false and failed past TYPES_DEPTH_MAX
+            //
+            bool enter( )
+            {
+                if ( m_depth >= TYPES_DEPTH_MAX )
+                {
+                    m_failed = true;
+                    return false;
+                }
+                
+                m_depth++;
+                return true;
+            }
+            
+            void leave( )
+            {
+                m_depth--;
+            }
+            
+            unsigned int version( ) const
+            {
+                return m_version;
+            }
+            
+            bool failed( ) const
+            {
+                return m_failed;
+            }
+            
+            unsigned long remaining( ) const
+            {
+                return m_end - m_pill.contents();
+            }
+            
+            //
+            //  false and failed if fewer than size bytes are left
+            //
+            bool has( unsigned long size )
+            {
+                if ( m_failed || size > remaining() )
+                {
+                    m_failed = true;
+                    return false;
+                }
+                
+                return true;
+            }
+            
+            char tag( )
+            {
+                if ( !has( sizeof( char ) ) )
+                {
+                    return 0;
+                }
+                
+                char tag = *m_pill.contents();
+                m_pill.move( sizeof( tag ) );
+                return tag;
+            }
+            
+            //
+            //  lua type of the value starting with the tag
+            //
+            int type( char tag ) const
+            {
+                return type( tag, m_version );
+            }
+            
+            static int type( char tag, unsigned int version );
+            
+            unsigned long varint( );
+            
+            //
+            //  length fields, 4 bytes in version 1
+            //
+            unsigned long length( );
+            
+            const char* contents( ) const
+            {
+                return m_pill.contents();
+            }
+            
+            void move( unsigned long length )
+            {
+                if ( has( length ) )
+                {
+                    m_pill.move( length );
+                }
+            }
+            
+            double number( char tag );
+            std::string string( char tag );
+            
+            typedef std::vector< std::string > Shape;
+            
+            //
+            //  keys of a shape defined or referred to by the tag, NULL for an unknown one
+            //
+            const Shape* shape( char tag );
+            
+            //
+            //  pushes the next value to the lua stack without loading it first
+            //
+            void push( const State& lua );
+            
+        private:
+            void table( const State& lua, char tag );
+            void function( const State& lua, char tag );
+            static const char* reader( lua_State* lua, void* data, size_t* size );
+            
+        private:
+            tau::Pill& m_pill;
+            unsigned int m_version;
+            const char* m_end;
+            bool m_failed;
+            unsigned int m_depth;
+            std::vector< std::string > m_strings;
+            std::deque< Shape > m_shapes;
+        };
+        
+        //
+        //  tables and functions met while loading one value, keyed by their lua pointers
+        //
+        class Visited
+        {
+        public:
+            //
+            //  what happens to a value reached again on another path, cycles are always cut
+            //
+            enum Shared
+            {
+                Copy,
+                Once,
+                Fail
+            };
+            
+            enum Mark
+            {
+                None,
+                Open,
+                Closed
+            };
+            
+            Visited( Shared shared = Copy )
+            : m_count( 0 ), m_shared( shared ), m_failed( false ), m_depth( 0 )
+            {
+            }
+            
+            Mark mark( const void* pointer ) const;
+            void set( const void* pointer, Mark mark );
+            
+            //
+            //  marks the value open, false and failed without marking it past TYPES_DEPTH_MAX
+            //
+            bool open( const void* pointer )
+            {
+                if ( m_depth >= TYPES_DEPTH_MAX )
+                {
+                    fail();
+                    return false;
+                }
+                
+                m_depth++;
+                set( pointer, Open );
+                return true;
+            }
+            
+            void close( const void* pointer )
+            {
+                m_depth--;
+                set( pointer, Closed );
+            }
+            
+            Shared shared( ) const
+            {
+                return m_shared;
+            }
+            
+            bool failed( ) const
+            {
+                return m_failed;
+            }
+            
+            void fail( )
+            {
+                m_failed = true;
+            }
+            
+        private:
+            struct Entry
+            {
+                const void* pointer;
+                Mark mark;
+                
+                Entry( )
+                : pointer( NULL ), mark( None )
+                {
+                }
+            };
+            
+            unsigned int slot( const void* pointer ) const;
+            
+        private:
+            std::vector< Entry > m_entries;
+            unsigned int m_count;
+            Shared m_shared;
+            bool m_failed;
+            unsigned int m_depth;
+        };
+        
+        //
+        //  128 bit structural hash of a lua value, taken in one pass over the stack,
+        //  values equal for Value::operator== always have the same digest
+        //
+        class Digest
+        {
+        public:
+            Digest( )
+            : m_high( 0x6a09e667f3bcc908UL ), m_low( 0xbb67ae8584caa73bUL )
+            {
+            }
+            
+            //
+            //  false if the value would not be loaded either
+            //
+            static bool take( const State& lua, int index, Digest& digest, Visited::Shared shared = Visited::Copy );
+            
+            bool operator==( const Digest& digest ) const
+            {
+                return m_high == digest.m_high && m_low == digest.m_low;
+            }
+            
+            bool operator!=( const Digest& digest ) const
+            {
+                return !( *this == digest );
+            }
+            
+            //
+            //  32 hex digits
+            //
+            std::string tostring( ) const;
+            
+            //
+            //  the 16 bytes of the digest
+            //
+            std::string raw( ) const
+            {
+                return std::string( ( const char* ) &m_high, sizeof( m_high ) ) + std::string( ( const char* ) &m_low, sizeof( m_low ) );
+            }
+            
+            static Digest of( const char* data, unsigned long length )
+            {
+                Digest digest;
+                digest.bytes( data, length );
+                return digest;
+            }
+            
+        private:
+            static bool value( const State& lua, int index, Visited& visited, Digest& digest, bool copy = false );
+            bool table( const State& lua, int index, Visited& visited );
+            bool function( const State& lua, int index, Visited& visited );
+            
+            //
+            //  ordered mixing of values and bytes, add is order independent for pairs of tables
+            //
+            void mix( unsigned long value );
+            void bytes( const char* data, unsigned long length );
+            
+            void mix( const Digest& digest )
+            {
+                mix( digest.m_high );
+                mix( digest.m_low );
+            }
+            
+            void add( const Digest& digest )
+            {
+                m_high += digest.m_high;
+                m_low += digest.m_low;
+            }
+            
+            static int writer( lua_State* lua, const void* data, size_t size, void* digest );
+            
+        private:
+            unsigned long m_high;
+            unsigned long m_low;
+        };
+        
+#define PROTOTYPES_KEY_SIZE 16
+#define PROTOTYPES_MAX 4096
+        
+        //
+        //  bytecode of functions passed between lines, kept once per process by the digest of the code,
+        //  every line remembers the keys of the functions it dumped and the functions it loaded
+        //
+        class Prototypes
+        {
+        public:
+            //
+            //  key of the code of the function at index, it is dumped only the first time the line 
+            //  passes the function, false if the code is not cached, which is also remembered
+            //
+            static bool key( const State& lua, int index, std::string& key );
+            
+            //
+            //  pushes a new function of the code of key, every load gets a closure of its own,
+            //  false and nothing pushed if the key is unknown
+            //
+            static bool push( const State& lua, const std::string& key );
+            
+            //
+            //  code of key or NULL, it stays valid for the life of the process
+            //
+            static const std::string* code( const std::string& key );
+            
+            static unsigned int size( );
+            
+        private:
+            static int writer( lua_State* lua, const void* data, size_t size, void* code );
+            static void registry( const State& lua, const char* name, const char* mode );
+            
+        private:
+            static std::unordered_map< std::string, std::string > s_codes;
+            static tau::si::Lock s_lock;
+        };
+        
         class Value : public  tau::ie::Tok
         {
             friend class Table;
             friend class Function;
+            friend class Stream;
             
         public:
             virtual ~Value( )
@@ -35,7 +538,14 @@ namespace lua
 
             static Value* load( tau::Pill& );
             static void dump( tau::Pill& pill, const Value& value );
-            static Value* load( const State& lua, int index = -1, bool pop = true, const Value* parent = NULL );
+            static Value* load( const State& lua, int index = -1, bool pop = true, Visited::Shared shared = Visited::Copy );
+            
+            //
+            //  straight between the lua stack and the pill, the value at index is not popped
+            //  and nothing is pushed if the pill is not a dump
+            //
+            static bool dump( tau::Pill& pill, const State& lua, int index, Visited::Shared shared = Visited::Copy, bool cached = false );
+            static bool load( tau::Pill& pill, const State& lua );
            
             virtual std::string tostring( ) const
             {
@@ -51,52 +561,39 @@ namespace lua
             static const tau::Grain::Generators& populate();
             
         protected:
-            virtual void init( const State& lua, int index = -1 ) 
+            virtual void init( const State& lua, int index, Visited& visited ) 
             {
             }
             
-            virtual void init( tau::Pill& pill )
+            //
+            //  loads a nested value without popping it, NULL if it was cut,
+            //  copy loads a shared value again whatever the policy, as metatables of instances
+            //
+            static Value* load( const State& lua, int index, Visited& visited, bool copy = false );
+            
+            virtual void init( Decoder& decoder, char tag )
             {
             }
             
-            static Value* create( tau::Pill& pill );
+            static Value* create( Decoder& decoder );
+            static Value* create( Decoder& decoder, char tag );
             
             Value( unsigned int type = 0 )
             : m_type( type )
             {
             }
             
-            void dump( tau::Pill& ) const;
-
-            void setParent( const Value* parent )
-            {
-                m_parent = parent;
-            }
-            
-            const Value* parent() const
-            {
-                return m_parent;
-            }
-            
-            const std::string& id() const
-            {
-                return m_id;
-            }
-            
-            void setId( const State& lua, int index )
+            void dump( Encoder& encoder ) const
             {
-                m_id = lua.objectid( index );
+                data( encoder );
             }
-            
-            bool check( const std::string& id ) const;
-            
+
             void setType( char type )
             {
                 m_type = type;
             }
             
         private:
-#define TYPES_VERSION 1
             struct Header
             {
                 unsigned int version;
@@ -108,9 +605,16 @@ namespace lua
 
                 }
             };
+            
+            //
+            //  header of a whole dump of a supported version or NULL
+            //
+            static const Header* header( const tau::Pill& pill );
+            static void seal( tau::Pill& pill );
 
-            virtual void data( tau::Pill& ) const 
+            virtual void data( Encoder& encoder ) const 
             {
+                encoder.nil();
             }
             
             virtual unsigned int hash( ) const
@@ -119,23 +623,24 @@ namespace lua
             }
             
         private:
-            const Value* m_parent;
             char m_type;
-            std::string m_id;
         };
 
         typedef std::vector< Value* > Values;
 
         class String : public Value
         {
+            friend class Stream;
+            
            
         public:
             String( const std::string& value )
-            : m_value( value )
+            : Value( LUA_TSTRING ), m_value( value )
             {
             }
             
             String( const char* format, ... )
+            : Value( LUA_TSTRING )
             {
                 va_list args;
                 va_start( args, format );
@@ -144,6 +649,7 @@ namespace lua
             }
             
             String( const char* format, va_list args )
+            : Value( LUA_TSTRING )
             {
                 m_value = String::format( format, args );
             }
@@ -163,6 +669,11 @@ namespace lua
                 return m_value;
             }
             
+            const std::string& value( ) const
+            {
+                return m_value;
+            }
+            
             static std::string format( const char* format, va_list args )
             {
                 char buffer[ 1024 ];
@@ -188,13 +699,13 @@ namespace lua
             {
             }
             
-            virtual void init( const State& lua, int index = -1 )
+            virtual void init( const State& lua, int index, Visited& )
             {
                 m_value = lua_tostring( lua, index );
             }
             
-            virtual void init( tau::Pill& );
-            void data( tau::Pill& ) const;
+            virtual void init( Decoder& decoder, char tag );
+            void data( Encoder& encoder ) const;
             
             virtual unsigned int hash( ) const
             {
@@ -217,11 +728,19 @@ namespace lua
         
         class Simple : public Value
         {
+            friend class Stream;
+            
             
         public:            
             virtual void push( const State& lua ) const
             {
-                ( Value::type() == LUA_TBOOLEAN ) ? lua.push( ( bool ) m_value ) : lua.push( ( long ) m_value );
+                if ( Value::type() == LUA_TBOOLEAN )
+                {
+                    lua.push( ( bool ) m_value );
+                    return;
+                }
+                
+                lua.grow( [ & ]( ) { lua_pushnumber( lua, m_value ); } );
             }
             
             virtual bool operator==( const Value& value ) const
@@ -241,14 +760,14 @@ namespace lua
             {
             }
             
-            virtual void init( const State& lua, int index = -1 )
+            virtual void init( const State& lua, int index, Visited& )
             {
                 assert( Value::type() );
-                m_value = ( Value::type() == LUA_TNUMBER ) ? lua_toboolean( lua, index ) : lua_tonumber( lua, index );
+                m_value = ( Value::type() == LUA_TBOOLEAN ) ? lua_toboolean( lua, index ) : lua_tonumber( lua, index );
             }
             
-            virtual void init( tau::Pill& );
-            virtual void data( tau::Pill& ) const;
+            virtual void init( Decoder& decoder, char tag );
+            virtual void data( Encoder& encoder ) const;
             
             virtual unsigned int hash( ) const
             {
@@ -261,12 +780,14 @@ namespace lua
             }
 
         private:
-            long m_value;
+            double m_value;
             char m_type;
         };
 
         class Function : public Value
         {
+            friend class Stream;
+            
         public:
             Function( const Function& value )
             : m_reference( value.m_reference ), m_script( value.m_script )
@@ -275,7 +796,7 @@ namespace lua
             }
             
             virtual void push( const State& ) const;
-            virtual void data( tau::Pill& ) const;
+            virtual void data( Encoder& encoder ) const;
             virtual bool operator==( const Value& ) const;
 
             virtual ~Function( );
@@ -316,8 +837,8 @@ namespace lua
             {
             }
             
-            virtual void init( const State& lua, int index = -1 );
-            virtual void init( tau::Pill& );
+            virtual void init( const State& lua, int index, Visited& visited );
+            virtual void init( Decoder& decoder, char tag );
             int writer( const void* buffer, size_t size );
             const char* reader( size_t* );
             static int writerStatic( lua_State *lua, const void* buffer, size_t size, void* data );
@@ -340,20 +861,20 @@ namespace lua
 
         class Table : public Value
         {
-        public:
-            typedef std::pair< Value*, Value* > Type;
+            friend class Stream;
             
+        public:
             virtual ~Table( );
             virtual void push( const State& ) const;
-            virtual void data( tau::Pill& ) const;
+            virtual void data( Encoder& encoder ) const;
             virtual bool operator==( const Value& ) const;
 
-            typedef std::map< Value*, Value* > Values;
-            const Values& map( ) const
+            void set( const std::string& key, Value* value );
+            
+            unsigned int size( ) const
             {
-                return m_map;
+                return m_array.size() + m_count;
             }
-            void set( const std::string& key, Value* value );
             
             static tau::Grain* create()
             {
@@ -366,21 +887,79 @@ namespace lua
             }
 
         private:
+            //
+            //  numbers and booleans are kept inline, other values are owned by the table
+            //
+            struct Item
+            {
+                char type;
+                union
+                {
+                    double number;
+                    Value* value;
+                };
+                
+                Item( )
+                : type( LUA_TNIL ), value( NULL )
+                {
+                }
+                
+                Item( Value* _value )
+                : type( _value->type() ), value( _value )
+                {
+                }
+                
+                bool inlined( ) const
+                {
+                    return type == LUA_TNUMBER || type == LUA_TBOOLEAN;
+                }
+                
+                bool same( const Item& item ) const;
+                bool equals( const Item& item ) const;
+                unsigned int hash( ) const;
+                
+                void push( const State& lua ) const;
+                void dump( Encoder& encoder ) const;
+                bool load( Decoder& decoder );
+                bool load( const State& lua, int index, Visited& visited );
+                void destroy( );
+            };
+            
+            //
+            //  slot of the hash part, free while the key is nil
+            //
+            struct Entry
+            {
+                Item key;
+                Item value;
+                unsigned int hash;
+                
+                Entry( )
+                : hash( 0 )
+                {
+                }
+            };
+            
+            typedef std::vector< Item > Array;
+            typedef std::vector< Entry > Hash;
+            
             Table( )
-            : m_mt( NULL )
+            : m_mt( NULL ), m_count( 0 )
             {
             }
             
             virtual void cleanup();
-            virtual void init( const State& lua, int index = -1 );
-            virtual void init( tau::Pill& );
+            virtual void init( const State& lua, int index, Visited& visited );
+            virtual void init( Decoder& decoder, char tag );
             
-            const Value* value( const std::string& key );
-            static Values parseTable( tau::Pill& );
-            void insert( const Type& );
+            void insert( const Item& key, const Item& value );
+            const Item* find( const Item& key ) const;
+            void rehash( unsigned int capacity );
             
-            typedef std::map< std::string, Value* > Strings;
-            void index();
+            //
+            //  position in the array part of an integer key or -1
+            //
+            long position( const Item& key ) const;
             
             virtual unsigned int hash( ) const
             {
@@ -389,8 +968,132 @@ namespace lua
             
         private:
             Table* m_mt;
-            Values m_map;
-            Strings m_strings;
+            Array m_array;
+            Hash m_hash;
+            unsigned int m_count;
+        };
+        
+#define STREAM_RESERVE_MAX ( 1 << 16 )
+        
+        //
+        //  incremental decoder of dumps, bytes are consumed as they arrive and parse state is 
+        //  kept between writes, every value is ready as soon as its last byte is in
+        //
+        class Stream
+        {
+        public:
+            Stream( );
+            ~Stream( );
+            
+            //
+            //  false if the bytes are not a dump, the stream has to be cleared then
+            //
+            bool write( const char* data, unsigned long length );
+            
+            //
+            //  takes the next complete value, owned by the caller and NULL for nil,
+            //  false if there is none yet
+            //
+            bool read( Value*& value );
+            
+            unsigned int size( ) const
+            {
+                return m_values.size();
+            }
+            
+            //
+            //  drops the partial and the complete values
+            //
+            void clear( );
+            
+        private:
+            //
+            //  kind of the next bytes
+            //
+            enum Token
+            {
+                Header,
+                Tag,
+                Varint,
+                Fixed,
+                Bytes
+            };
+            
+            //
+            //  what the read token is for
+            //
+            enum Use
+            {
+                Any,
+                Integer,
+                Double,
+                Long,
+                Boolean,
+                Reference,
+                StringLength,
+                StringBytes,
+                CodeLength,
+                CodeBytes,
+                Upvalues,
+                ArrayLength,
+                PairsLength,
+                ShapeLength,
+                ShapeIndex
+            };
+            
+            struct Frame
+            {
+                enum Phase
+                {
+                    Array,
+                    Pairs,
+                    Meta,
+                    Closures,
+                    Keys,
+                    Fields
+                };
+                
+                types::Value* value;
+                Phase phase;
+                unsigned long left;
+                Table::Item key;
+                bool keyed;
+                unsigned int shape;
+                
+                Frame( types::Value* _value, Phase _phase, unsigned long _left )
+                : value( _value ), phase( _phase ), left( _left ), keyed( false ), shape( 0 )
+                {
+                }
+            };
+            
+            void expect( Token token, Use use, unsigned long size = 0 );
+            void length( Use use );
+            
+            bool header( );
+            bool tag( char tag );
+            bool fixed( );
+            bool integer( unsigned long value );
+            bool bytes( );
+            bool complete( Table::Item item );
+            
+            static types::Value* value( const Table::Item& item );
+            
+        private:
+            Token m_token;
+            Use m_use;
+            unsigned long m_size;
+            unsigned long m_filled;
+            unsigned long m_integer;
+            unsigned int m_shift;
+            char m_buffer[ 8 ];
+            unsigned int m_version;
+            bool m_failed;
+            
+            String* m_target;
+            std::vector< Frame > m_frames;
+            std::vector< std::string > m_strings;
+            std::vector< Decoder::Shape > m_shapes;
+            std::deque< types::Value* > m_values;
         };
     }
 }
@@ -0,0 +1,188 @@
+#ifndef VEGA_QUEUE_H
+#define	VEGA_QUEUE_H
+
+#include <atomic>
+
+//
+//  multiple producer single consumer queue of intrusive items,
+//  items are expected to have a "next" pointer member
+//
+template< class Item > class Inbox
+{
+public:
+    Inbox( )
+    : m_head( NULL )
+    {
+    }
+
+    //
+    //  can be called from any thread
+    //
+    void push( Item* item )
+    {
+        auto head = m_head.load( std::memory_order_relaxed );
+
+        do
+        {
+            item->next = head;
+        }
+        while ( !m_head.compare_exchange_weak( head, item, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    //
+    //  takes all the queued items in order of arrival, only called by the consumer
+    //
+    Item* take( )
+    {
+        auto item = m_head.exchange( NULL, std::memory_order_acquire );
+        Item* list = NULL;
+
+        while ( item )
+        {
+            auto next = item->next;
+            item->next = list;
+            list = item;
+            item = next;
+        }
+
+        return list;
+    }
+
+    bool empty( ) const
+    {
+        return !m_head.load( std::memory_order_relaxed );
+    }
+
+private:
+    std::atomic< Item* > m_head;
+};
+
+//
+//  bounded single producer single consumer ring, Size has to be a power of 2
+//
+template< class Item, unsigned int Size > class Ring
+{
+public:
+    Ring( )
+    : m_head( 0 ), m_tail( 0 )
+    {
+    }
+
+    //
+    //  producer side, returns false if the ring is full
+    //
+    bool push( const Item& item )
+    {
+        auto tail = m_tail.load( std::memory_order_relaxed );
+        if ( tail - m_head.load( std::memory_order_acquire ) == Size )
+        {
+            return false;
+        }
+
+        m_items[ tail & ( Size - 1 ) ] = item;
+        m_tail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    //
+    //  consumer side, returns false if the ring is empty
+    //
+    bool pop( Item& item )
+    {
+        auto head = m_head.load( std::memory_order_relaxed );
+        if ( head == m_tail.load( std::memory_order_acquire ) )
+        {
+            return false;
+        }
+
+        item = m_items[ head & ( Size - 1 ) ];
+        m_head.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    bool empty( ) const
+    {
+        return m_head.load( std::memory_order_acquire ) == m_tail.load( std::memory_order_acquire );
+    }
+
+private:
+    Item m_items[ Size ];
+    
+    //
+    //  keep producer and consumer indexes on separate cache lines
+    //
+    alignas( 64 ) std::atomic< unsigned int > m_head;
+    alignas( 64 ) std::atomic< unsigned int > m_tail;
+};
+
+//
+//  bounded fifo used by a single thread, Size has to be a power of 2
+//
+template< class Item, unsigned int Size > class Fifo
+{
+public:
+    Fifo( )
+    : m_head( 0 ), m_tail( 0 )
+    {
+    }
+    
+    //
+    //  returns false if the fifo is full
+    //
+    bool push( const Item& item )
+    {
+        if ( size() == Size )
+        {
+            return false;
+        }
+        
+        m_items[ m_tail++ & ( Size - 1 ) ] = item;
+        return true;
+    }
+    
+    bool pop( Item& item )
+    {
+        if ( empty() )
+        {
+            return false;
+        }
+        
+        item = m_items[ m_head++ & ( Size - 1 ) ];
+        return true;
+    }
+    
+    bool contains( const Item& item ) const
+    {
+        for ( auto i = m_head; i != m_tail; i++ )
+        {
+            if ( m_items[ i & ( Size - 1 ) ] == item )
+            {
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    unsigned int size( ) const
+    {
+        return m_tail - m_head;
+    }
+    
+    bool empty( ) const
+    {
+        return m_head == m_tail;
+    }
+    
+    void clear( )
+    {
+        m_head = m_tail = 0;
+    }
+    
+private:
+    Item m_items[ Size ];
+    unsigned int m_head;
+    unsigned int m_tail;
+};
+
+#endif
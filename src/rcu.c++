@@ -0,0 +1,109 @@
+#include "rcu.h"
+
+#define RCU_OFFLINE ( ( unsigned long ) -1 )
+
+std::atomic< unsigned long > Rcu::s_epoch( 1 );
+std::atomic< unsigned long > Rcu::s_newest( 0 );
+std::atomic< unsigned long > Rcu::s_oldest( RCU_OFFLINE );
+std::atomic< unsigned long > Rcu::s_seen[ VEGA_LINES_MAX ];
+std::atomic< unsigned int > Rcu::s_lines( 0 );
+std::atomic< unsigned int > Rcu::s_pending( 0 );
+std::list< Rcu::Retired > Rcu::s_retired;
+tau::si::Lock Rcu::s_lock;
+
+void Rcu::online( unsigned int slot )
+{
+    tau::si::Gate gate( s_lock );
+    
+    for ( auto i = s_lines.load(); i < slot; i++ )
+    {
+        s_seen[ i ] = RCU_OFFLINE;
+    }
+    
+    s_seen[ slot ] = s_epoch.load();
+    
+    if ( s_lines <= slot )
+    {
+        s_lines = slot + 1;
+    }
+}
+
+void Rcu::offline( unsigned int slot )
+{
+    s_seen[ slot ] = RCU_OFFLINE;
+    quiescent( slot );
+}
+
+void Rcu::quiescent( unsigned int slot )
+{
+    //
+    //  objects retired in the current epoch are freed once every line saw the next one
+    //
+    auto epoch = s_newest.load();
+    if ( s_pending && epoch == s_epoch )
+    {
+        s_epoch.compare_exchange_strong( epoch, epoch + 1 );
+    }
+    
+    if ( s_seen[ slot ] != RCU_OFFLINE )
+    {
+        s_seen[ slot ] = s_epoch.load();
+    }
+    
+    if ( s_pending )
+    {
+        collect();
+    }
+}
+
+bool Rcu::behind( unsigned int slot )
+{
+    auto seen = s_seen[ slot ].load();
+    auto oldest = s_oldest.load();
+    
+    return seen != RCU_OFFLINE && oldest != RCU_OFFLINE && seen <= oldest;
+}
+
+void Rcu::retire( const Free& free )
+{
+    tau::si::Gate gate( s_lock );
+    
+    s_newest = s_epoch.load();
+    s_retired.push_back( Retired( s_newest, free ) );
+    
+    if ( !s_pending++ )
+    {
+        s_oldest = s_newest.load();
+    }
+}
+
+void Rcu::collect( )
+{
+    std::list< Retired > expired;
+    
+    {
+        tau::si::Gate gate( s_lock );
+        
+        auto oldest = RCU_OFFLINE;
+        for ( unsigned int i = 0; i < s_lines; i++ )
+        {
+            oldest = std::min< unsigned long >( oldest, s_seen[ i ] );
+        }
+        
+        //
+        //  retired objects are ordered by epoch
+        //
+        while ( !s_retired.empty() && s_retired.front().epoch < oldest )
+        {
+            expired.splice( expired.end(), s_retired, s_retired.begin() );
+            s_pending--;
+        }
+        
+        s_oldest = s_retired.empty() ? RCU_OFFLINE : s_retired.front().epoch;
+    }
+    
+    for ( auto i = expired.begin(); i != expired.end(); i++ )
+    {
+        i->free();
+    }
+}
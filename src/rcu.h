@@ -0,0 +1,70 @@
+#ifndef VEGA_RCU_H
+#define	VEGA_RCU_H
+
+#include "common.h"
+#include <functional>
+#include <tau/si.h>
+
+//
+//  quiescent state based reclamation, objects unlinked from shared structures are freed 
+//  only after every line went through its tick, where no line code can hold references to them
+//
+class Rcu
+{
+public:
+    typedef std::function< void( ) > Free;
+    
+    static void online( unsigned int slot );
+    static void offline( unsigned int slot );
+    
+    //
+    //  called by the line between events
+    //
+    static void quiescent( unsigned int slot );
+    
+    //
+    //  can be called from any line
+    //
+    static void retire( const Free& free );
+    
+    static unsigned int pending( )
+    {
+        return s_pending;
+    }
+    
+    //
+    //  the line in slot has not gone through its tick since the oldest retire
+    //
+    static bool behind( unsigned int slot );
+    
+private:
+    static void collect( );
+    
+    struct Retired
+    {
+        unsigned long epoch;
+        Free free;
+        
+        Retired( unsigned long _epoch, const Free& _free )
+        : epoch( _epoch ), free( _free )
+        {
+        }
+    };
+    
+private:
+    static std::atomic< unsigned long > s_epoch;
+    
+    //
+    //  epochs of the newest and the oldest retired objects, retires within an epoch share it
+    //  so a burst of writes moves the epoch once
+    //
+    static std::atomic< unsigned long > s_newest;
+    static std::atomic< unsigned long > s_oldest;
+    static std::atomic< unsigned long > s_seen[ VEGA_LINES_MAX ];
+    static std::atomic< unsigned int > s_lines;
+    static std::atomic< unsigned int > s_pending;
+    static std::list< Retired > s_retired;
+    static tau::si::Lock s_lock;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "search.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
+Search::Find Search::s_find = Search::dispatch();
+
+long Search::find( const char* data, unsigned long length, const char* what, unsigned long size, unsigned long start )
+{
+    if ( start > length || size > length - start )
+    {
+        return -1;
+    }
+
+    if ( !size )
+    {
+        return start;
+    }
+
+    auto found = s_find( data + start, length - start, what, size );
+    return found < 0 ? found : found + start;
+}
+
+const char* Search::engine( )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    if ( s_find == &Search::avx2 )
+    {
+        return "avx2";
+    }
+
+    if ( s_find == &Search::sse2 )
+    {
+        return "sse2";
+    }
+#endif
+
+    return "scalar";
+}
+
+Search::Find Search::dispatch( )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        return &Search::avx2;
+    }
+
+    if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        return &Search::sse2;
+    }
+#endif
+
+    return &Search::scalar;
+}
+
+long Search::scalar( const char* data, unsigned long length, const char* what, unsigned long size )
+{
+    if ( size > length )
+    {
+        return -1;
+    }
+    
+    auto last = data + length - size;
+
+    for ( auto i = data; i <= last; i++ )
+    {
+        i = ( const char* ) memchr( i, *what, last - i + 1 );
+        if ( !i )
+        {
+            break;
+        }
+
+        if ( !memcmp( i + 1, what + 1, size - 1 ) )
+        {
+            return i - data;
+        }
+    }
+
+    return -1;
+}
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+//
+//  blocks of positions are filtered by comparing both the first and the last byte of what,
+//  only the candidates matching both are compared in full
+//
+__attribute__(( target( "sse2" ) ))
+long Search::sse2( const char* data, unsigned long length, const char* what, unsigned long size )
+{
+    const auto first = _mm_set1_epi8( what[ 0 ] );
+    const auto last = _mm_set1_epi8( what[ size - 1 ] );
+
+    unsigned long i = 0;
+    for ( ; i + size - 1 + 16 <= length; i += 16 )
+    {
+        auto head = _mm_loadu_si128( ( const __m128i* ) ( data + i ) );
+        auto tail = _mm_loadu_si128( ( const __m128i* ) ( data + i + size - 1 ) );
+
+        unsigned int mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( head, first ), _mm_cmpeq_epi8( tail, last ) ) );
+
+        while ( mask )
+        {
+            auto bit = __builtin_ctz( mask );
+            if ( size <= 2 || !memcmp( data + i + bit + 1, what + 1, size - 2 ) )
+            {
+                return i + bit;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    auto found = scalar( data + i, length - i, what, size );
+    return found < 0 ? found : found + i;
+}
+
+__attribute__(( target( "avx2" ) ))
+long Search::avx2( const char* data, unsigned long length, const char* what, unsigned long size )
+{
+    const auto first = _mm256_set1_epi8( what[ 0 ] );
+    const auto last = _mm256_set1_epi8( what[ size - 1 ] );
+
+    unsigned long i = 0;
+    for ( ; i + size - 1 + 32 <= length; i += 32 )
+    {
+        auto head = _mm256_loadu_si256( ( const __m256i* ) ( data + i ) );
+        auto tail = _mm256_loadu_si256( ( const __m256i* ) ( data + i + size - 1 ) );
+
+        unsigned int mask = _mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( head, first ), _mm256_cmpeq_epi8( tail, last ) ) );
+
+        while ( mask )
+        {
+            auto bit = __builtin_ctz( mask );
+            if ( size <= 2 || !memcmp( data + i + bit + 1, what + 1, size - 2 ) )
+            {
+                return i + bit;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    auto found = sse2( data + i, length - i, what, size );
+    return found < 0 ? found : found + i;
+}
+
+#endif
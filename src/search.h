@@ -0,0 +1,39 @@
+#ifndef VEGA_SEARCH_H
+#define	VEGA_SEARCH_H
+
+#include "common.h"
+
+//
+//  substring search used by the find methods, the widest implementation the cpu supports
+//  is picked once at startup and the others fall back to a plain scalar loop
+//
+class Search
+{
+public:
+    typedef long ( *Find )( const char* data, unsigned long length, const char* what, unsigned long size );
+
+    //
+    //  position of what in data at or after start, -1 if it is not there
+    //
+    static long find( const char* data, unsigned long length, const char* what, unsigned long size, unsigned long start = 0 );
+
+    //
+    //  name of the implementation in use
+    //
+    static const char* engine( );
+
+private:
+    static long scalar( const char* data, unsigned long length, const char* what, unsigned long size );
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+    static long sse2( const char* data, unsigned long length, const char* what, unsigned long size );
+    static long avx2( const char* data, unsigned long length, const char* what, unsigned long size );
+#endif
+
+    static Find dispatch( );
+
+private:
+    static Find s_find;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "slab.h"
+
+Slab::Cache Slab::s_caches[ VEGA_LINES_MAX ];
+Slab::List Slab::s_depot[ SLAB_CLASSES ];
+std::atomic< long > Slab::s_cached( 0 );
+std::atomic< long > Slab::s_used( 0 );
+tau::si::Lock Slab::s_lock;
+
+__thread Slab::Cache* Slab::s_cache = NULL;
+
+int Slab::index( unsigned int size )
+{
+    if ( size > Slab::size( SLAB_CLASSES - 1 ) )
+    {
+        return -1;
+    }
+    
+    unsigned int index = 0;
+    while ( Slab::size( index ) < size )
+    {
+        index++;
+    }
+    
+    return index;
+}
+
+void* Slab::allocate( unsigned int size, unsigned int& capacity )
+{
+    auto index = Slab::index( size );
+    if ( index < 0 )
+    {
+        capacity = size;
+        s_used += size;
+        return malloc( size );
+    }
+    
+    capacity = Slab::size( index );
+    
+    auto cache = s_cache;
+    if ( !cache )
+    {
+        s_used += capacity;
+        return malloc( capacity );
+    }
+    
+    auto& list = cache->lists[ index ];
+    if ( !list.head )
+    {
+        refill( *cache, index );
+    }
+    
+    cache->used.fetch_add( capacity, std::memory_order_relaxed );
+    
+    auto block = list.head;
+    if ( !block )
+    {
+        return malloc( capacity );
+    }
+    
+    list.head = block->next;
+    list.count--;
+    cache->cached.fetch_sub( capacity, std::memory_order_relaxed );
+    
+    return block;
+}
+
+//
+//  blocks go to the cache of the line freeing them, whichever line allocated them
+//
+void Slab::free( void* data, unsigned int capacity )
+{
+    if ( !data )
+    {
+        return;
+    }
+    
+    auto index = Slab::index( capacity );
+    auto cache = s_cache;
+    
+    if ( index < 0 || !cache )
+    {
+        s_used -= capacity;
+        ::free( data );
+        return;
+    }
+    
+    auto& list = cache->lists[ index ];
+    auto block = static_cast< Block* >( data );
+    
+    block->next = list.head;
+    list.head = block;
+    list.count++;
+    
+    cache->used.fetch_sub( capacity, std::memory_order_relaxed );
+    cache->cached.fetch_add( capacity, std::memory_order_relaxed );
+    
+    if ( list.count > SLAB_CACHE_MAX )
+    {
+        drain( *cache, index, SLAB_BATCH );
+    }
+}
+
+void Slab::refill( Cache& cache, unsigned int index )
+{
+    auto& list = cache.lists[ index ];
+    auto& depot = s_depot[ index ];
+    unsigned int count = 0;
+    
+    {
+        tau::si::Gate gate( s_lock );
+        
+        while ( depot.head && count < SLAB_BATCH )
+        {
+            auto block = depot.head;
+            depot.head = block->next;
+            
+            block->next = list.head;
+            list.head = block;
+            count++;
+        }
+        
+        depot.count -= count;
+    }
+    
+    list.count += count;
+    
+    long bytes = count * Slab::size( index );
+    s_cached -= bytes;
+    cache.cached.fetch_add( bytes, std::memory_order_relaxed );
+}
+
+//
+//  moves count blocks of the cache to the depot, the depot keeps up to SLAB_DEPOT_SIZE bytes 
+//  of a class and the rest is freed
+//
+void Slab::drain( Cache& cache, unsigned int index, unsigned int count )
+{
+    auto& list = cache.lists[ index ];
+    auto& depot = s_depot[ index ];
+    Block* spare = NULL;
+    unsigned int moved = 0;
+    
+    {
+        tau::si::Gate gate( s_lock );
+        
+        for ( ; moved < count && list.head; moved++ )
+        {
+            auto block = list.head;
+            list.head = block->next;
+            
+            if ( ( depot.count + 1 ) * Slab::size( index ) <= SLAB_DEPOT_SIZE )
+            {
+                block->next = depot.head;
+                depot.head = block;
+                depot.count++;
+                s_cached += Slab::size( index );
+            }
+            else
+            {
+                block->next = spare;
+                spare = block;
+            }
+        }
+    }
+    
+    list.count -= moved;
+    cache.cached.fetch_sub( moved * Slab::size( index ), std::memory_order_relaxed );
+    
+    while ( spare )
+    {
+        auto next = spare->next;
+        ::free( spare );
+        spare = next;
+    }
+}
+
+void Slab::online( unsigned int slot )
+{
+    s_cache = &s_caches[ slot ];
+}
+
+//
+//  the line is leaving, its free blocks are given to the depot and what it still uses
+//  is accounted globally
+//
+void Slab::offline( unsigned int slot )
+{
+    auto& cache = s_caches[ slot ];
+    
+    for ( unsigned int i = 0; i < SLAB_CLASSES; i++ )
+    {
+        drain( cache, i, cache.lists[ i ].count );
+    }
+    
+    s_used += cache.used.exchange( 0 );
+    s_cache = NULL;
+}
+
+Slab::Stats Slab::stats( )
+{
+    Stats stats = { s_used, s_cached };
+    
+    for ( unsigned int i = 0; i < VEGA_LINES_MAX; i++ )
+    {
+        stats.used += s_caches[ i ].used.load( std::memory_order_relaxed );
+        stats.cached += s_caches[ i ].cached.load( std::memory_order_relaxed );
+    }
+    
+    return stats;
+}
@@ -0,0 +1,82 @@
+#ifndef VEGA_SLAB_H
+#define	VEGA_SLAB_H
+
+#include "common.h"
+#include <tau/si.h>
+
+#define SLAB_SHIFT 6
+#define SLAB_CLASSES 11
+#define SLAB_BATCH 32
+#define SLAB_CACHE_MAX ( 4 * SLAB_BATCH )
+#define SLAB_DEPOT_SIZE ( 4 << 20 )
+
+//
+//  size class allocator for buffers, classes are powers of 2 from 64 bytes to 64k,
+//  every line keeps free blocks of each class without locking and moves them in batches
+//  to and from a shared depot, bigger buffers go to malloc
+//
+class Slab
+{
+public:
+    struct Stats
+    {
+        //
+        //  bytes handed out and bytes kept free in the caches and the depot
+        //
+        long used;
+        long cached;
+    };
+    
+    //
+    //  capacity is set to the usable size of the block, always at least size
+    //
+    static void* allocate( unsigned int size, unsigned int& capacity );
+    
+    //
+    //  capacity has to be the one given by allocate
+    //
+    static void free( void* data, unsigned int capacity );
+    
+    static void online( unsigned int slot );
+    static void offline( unsigned int slot );
+    
+    static Stats stats( );
+
+private:
+    struct Block
+    {
+        Block* next;
+    };
+    
+    struct List
+    {
+        Block* head;
+        unsigned int count;
+    };
+    
+    struct Cache
+    {
+        List lists[ SLAB_CLASSES ];
+        std::atomic< long > used;
+        std::atomic< long > cached;
+    };
+    
+    static int index( unsigned int size );
+    static unsigned int size( unsigned int index )
+    {
+        return 1 << ( index + SLAB_SHIFT );
+    }
+    
+    static void refill( Cache& cache, unsigned int index );
+    static void drain( Cache& cache, unsigned int index, unsigned int count );
+
+private:
+    static Cache s_caches[ VEGA_LINES_MAX ];
+    static List s_depot[ SLAB_CLASSES ];
+    static std::atomic< long > s_cached;
+    static std::atomic< long > s_used;
+    static tau::si::Lock s_lock;
+    static __thread Cache* s_cache;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "socket.h"
+
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+bool Socket::enabled( const base::Set::Options& options, const std::string& name )
+{
+    auto found = options.find( name );
+    if ( found == options.end() )
+    {
+        return false;
+    }
+    
+    return found->second != "0" && found->second != "false";
+}
+
+void Socket::listen( base::Set::Options& options )
+{
+#ifndef SO_REUSEPORT
+    throw lua::Exception( "reuseport is not supported on this platform" );
+#else
+    auto host = options.count( "host" ) ? options[ "host" ] : std::string();
+    auto port = options.count( "port" ) ? options[ "port" ] : std::string();
+    
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    
+    struct addrinfo* addresses = NULL;
+    auto result = getaddrinfo( host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &addresses );
+    if ( result )
+    {
+        throw lua::Exception( u::fprint( "cannot resolve %s:%s: %s", host.c_str(), port.c_str(), gai_strerror( result ) ) );
+    }
+    
+    int fd = -1;
+    int error = 0;
+    
+    for ( auto address = addresses; address; address = address->ai_next )
+    {
+        fd = socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+        if ( fd < 0 )
+        {
+            error = errno;
+            continue;
+        }
+        
+        int on = 1;
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+        setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) );
+        fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+        
+        if ( !bind( fd, address->ai_addr, address->ai_addrlen ) && !::listen( fd, SOMAXCONN ) )
+        {
+            break;
+        }
+        
+        error = errno;
+        close( fd );
+        fd = -1;
+    }
+    
+    freeaddrinfo( addresses );
+    
+    if ( fd < 0 )
+    {
+        throw lua::Exception( u::fprint( "cannot listen on %s:%s: %s", host.c_str(), port.c_str(), strerror( error ) ) );
+    }
+    
+    //
+    //  tau adopts the bound socket instead of opening its own
+    //
+    options[ "fd" ] = u::fprint( "%d", fd );
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef VEGA_SOCKET_H
+#define	VEGA_SOCKET_H
+
+#include "api.h"
+
+//
+//  listening sockets vega opens itself when tau cannot set the option before binding,
+//  so the listeners of every line can share a port
+//
+class Socket
+{
+public:
+    //
+    //  true unless the option is missing or set to 0 or false
+    //
+    static bool enabled( const base::Set::Options& options, const std::string& name );
+    
+    //
+    //  binds a listening socket for host and port with SO_REUSEPORT and hands its fd to tau
+    //  in options[ "fd" ], throws if the address cannot be bound
+    //
+    static void listen( base::Set::Options& options );
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "store.h"
+
+#define STORE_BUCKETS 16
+
+Store& Store::instance( )
+{
+    static Store store;
+    return store;
+}
+
+void Store::set( const std::string& key, const Value& value )
+{
+    auto hash = std::hash< std::string >()( key );
+    shard( hash ).set( key, hash, value );
+}
+
+bool Store::remove( const std::string& key )
+{
+    auto hash = std::hash< std::string >()( key );
+    return shard( hash ).remove( key, hash );
+}
+
+std::vector< std::string > Store::keys( ) const
+{
+    std::vector< std::string > keys;
+    
+    for ( unsigned int i = 0; i < STORE_SHARDS; i++ )
+    {
+        const Buckets* buckets = m_shards[ i ].buckets.load( std::memory_order_acquire );
+        
+        for ( unsigned int j = 0; j < buckets->size; j++ )
+        {
+            for ( auto node = buckets->heads[ j ].load( std::memory_order_acquire ); node; node = node->next.load( std::memory_order_acquire ) )
+            {
+                keys.push_back( node->key );
+            }
+        }
+    }
+    
+    return keys;
+}
+
+Store::Buckets::Buckets( unsigned int _size )
+: size( _size ), heads( new std::atomic< Node* >[ _size ] )
+{
+    for ( unsigned int i = 0; i < size; i++ )
+    {
+        heads[ i ] = NULL;
+    }
+}
+
+Store::Buckets::~Buckets( )
+{
+    delete [] heads;
+}
+
+Store::Shard::Shard( )
+: buckets( new Buckets( STORE_BUCKETS ) ), count( 0 )
+{
+}
+
+const Store::Node* Store::Shard::find( const std::string& key, size_t hash ) const
+{
+    const Buckets* buckets = this->buckets.load( std::memory_order_acquire );
+    
+    for ( auto node = buckets->head( hash ).load( std::memory_order_acquire ); node; node = node->next.load( std::memory_order_acquire ) )
+    {
+        if ( node->hash == hash && node->key == key )
+        {
+            return node;
+        }
+    }
+    
+    return NULL;
+}
+
+void Store::Shard::set( const std::string& key, size_t hash, const Value& value )
+{
+    tau::si::Gate gate( lock );
+    
+    Buckets* buckets = this->buckets.load( std::memory_order_relaxed );
+    auto link = &buckets->head( hash );
+    
+    for ( auto node = link->load( std::memory_order_relaxed ); node; node = node->next.load( std::memory_order_relaxed ) )
+    {
+        if ( node->hash == hash && node->key == key )
+        {
+            //
+            //  readers can still be walking the replaced node
+            //
+            link->store( new Node( key, hash, value, node->next.load( std::memory_order_relaxed ) ), std::memory_order_release );
+            Rcu::retire( [ node ]( ) { delete node; } );
+            return;
+        }
+        
+        link = &node->next;
+    }
+    
+    auto& head = buckets->head( hash );
+    head.store( new Node( key, hash, value, head.load( std::memory_order_relaxed ) ), std::memory_order_release );
+    count++;
+    
+    if ( count > buckets->size * 2 )
+    {
+        grow();
+    }
+}
+
+bool Store::Shard::remove( const std::string& key, size_t hash )
+{
+    tau::si::Gate gate( lock );
+    
+    Buckets* buckets = this->buckets.load( std::memory_order_relaxed );
+    auto link = &buckets->head( hash );
+    
+    for ( auto node = link->load( std::memory_order_relaxed ); node; node = node->next.load( std::memory_order_relaxed ) )
+    {
+        if ( node->hash == hash && node->key == key )
+        {
+            link->store( node->next.load( std::memory_order_relaxed ), std::memory_order_release );
+            Rcu::retire( [ node ]( ) { delete node; } );
+            count--;
+            
+            return true;
+        }
+        
+        link = &node->next;
+    }
+    
+    return false;
+}
+
+void Store::Shard::grow( )
+{
+    //
+    //  nodes of the old buckets are still linked for readers, so the new buckets get copies
+    //
+    Buckets* old = buckets.load( std::memory_order_relaxed );
+    Buckets* grown = new Buckets( old->size * 2 );
+    
+    for ( unsigned int i = 0; i < old->size; i++ )
+    {
+        for ( auto node = old->heads[ i ].load( std::memory_order_relaxed ); node; node = node->next.load( std::memory_order_relaxed ) )
+        {
+            auto& head = grown->head( node->hash );
+            head.store( new Node( node->key, node->hash, node->value, head.load( std::memory_order_relaxed ) ), std::memory_order_relaxed );
+        }
+    }
+    
+    buckets.store( grown, std::memory_order_release );
+    
+    Rcu::retire( [ old ]( ) 
+    {
+        for ( unsigned int i = 0; i < old->size; i++ )
+        {
+            auto node = old->heads[ i ].load( std::memory_order_relaxed );
+            while ( node )
+            {
+                auto next = node->next.load( std::memory_order_relaxed );
+                delete node;
+                node = next;
+            }
+        }
+        
+        delete old;
+    } );
+}
@@ -0,0 +1,102 @@
+#ifndef VEGA_STORE_H
+#define	VEGA_STORE_H
+
+#include "common.h"
+#include "rcu.h"
+
+#include <memory>
+
+//
+//  process wide string to pill map, sharded for writers and lock free for readers,
+//  unlinked nodes are freed through Rcu
+//
+class Store
+{
+public:
+    typedef std::shared_ptr< const tau::Pill > Value;
+    
+    static Store& instance( );
+    
+    //
+    //  calls read with the value if key is found, read must not keep the reference
+    //
+    template< class Read > bool get( const std::string& key, Read read ) const
+    {
+        auto hash = std::hash< std::string >()( key );
+        auto node = shard( hash ).find( key, hash );
+        
+        if ( node )
+        {
+            read( *node->value );
+        }
+        
+        return node != NULL;
+    }
+    
+    void set( const std::string& key, const Value& value );
+    bool remove( const std::string& key );
+    std::vector< std::string > keys( ) const;
+    
+private:
+    Store( )
+    {
+    }
+    
+    struct Node
+    {
+        std::string key;
+        size_t hash;
+        Value value;
+        std::atomic< Node* > next;
+        
+        Node( const std::string& _key, size_t _hash, const Value& _value, Node* _next )
+        : key( _key ), hash( _hash ), value( _value ), next( _next )
+        {
+        }
+    };
+    
+    struct Buckets
+    {
+        unsigned int size;
+        std::atomic< Node* >* heads;
+        
+        Buckets( unsigned int _size );
+        ~Buckets( );
+        
+        std::atomic< Node* >& head( size_t hash ) const
+        {
+            return heads[ hash & ( size - 1 ) ];
+        }
+    };
+    
+    struct Shard
+    {
+        std::atomic< Buckets* > buckets;
+        unsigned int count;
+        tau::si::Lock lock;
+        
+        Shard( );
+        
+        const Node* find( const std::string& key, size_t hash ) const;
+        void set( const std::string& key, size_t hash, const Value& value );
+        bool remove( const std::string& key, size_t hash );
+        void grow( );
+    };
+    
+#define STORE_SHARDS 64
+    
+    const Shard& shard( size_t hash ) const
+    {
+        return m_shards[ ( hash >> 16 ) % STORE_SHARDS ];
+    }
+    
+    Shard& shard( size_t hash )
+    {
+        return m_shards[ ( hash >> 16 ) % STORE_SHARDS ];
+    }
+    
+private:
+    Shard m_shards[ STORE_SHARDS ];
+};
+
+#endif
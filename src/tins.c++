@@ -1,12 +1,33 @@
 #include "tins.h"
 #include "lua/types.h"
+#include "search.h"
+#include "slab.h"
+#include "rcu.h"
 
+#include <errno.h>
+#include <event2/event.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
-void Link::onIndex( const Main::Router& router, h::Table& table )
+
+void Link::onIndex( const Main::Router& router, const lua::State& lua )
 {
     ENTER();
     
+    //
+    //  handlers of the calls were already taken over by a previous push
+    //
+    if ( !m_calls.empty() )
+    {
+        return;
+    }
+    
+    m_calls.resize( router.calls().size() );
+    
     std::for_each( router.calls().begin(), router.calls().end(), [ & ] ( const Main::Router::Call::Map::value_type& value ) 
     { 
         auto& call = value.second;
@@ -18,7 +39,7 @@ void Link::onIndex( const Main::Router& router, h::Table& table )
                 TRACE( "call 0x%x(%s) mapped to type %d", &call, call.name.c_str(), type );
                 auto& handlers = in::Female::handlers();
                 
-                m_calls.insert( Calls::value_type( &call, State( type, handlers.at( type ) ) ) );
+                m_calls[ call.index ] = State( type, handlers.at( type ) );
                 handlers.erase( type );
             }
             catch ( const std::out_of_range& )
@@ -29,44 +50,74 @@ void Link::onIndex( const Main::Router& router, h::Table& table )
     } );
 }
 
+Link::State* Link::state( const Api::Call* call )
+{
+    if ( call && call->index < m_calls.size() && m_calls[ call->index ].type )
+    {
+        return &m_calls[ call->index ];
+    }
+    
+    return NULL;
+}
+
 void Link::queue( const tau::Pair& pair )
 {
     ENTER();
-    State* state = NULL;
-    auto found = m_calls.find( m_call );
+    auto state = this->state( m_call );
 
-    if ( found != m_calls.end() )
-    {
-        state = &found->second;
-    }
-    else if ( !m_call )
+    if ( !state && !m_call )
     {
-        std::for_each( m_calls.begin(), m_calls.end(), [ & ] ( Calls::value_type& value ) 
+        for ( auto i = m_calls.begin(); i != m_calls.end(); i++ )
         {
-            if ( value.second.type == pair.first )
+            if ( i->type == pair.first )
             {
-                state = &value.second;
+                state = &( *i );
+                break;
             }
-        } );
+        }
     }
     
-    if ( state )
+    if ( !state )
+    {
+        return;
+    }
+    
+    //
+    //  a readiness event already waiting says it all
+    //
+    if ( state->queue.contains( pair ) )
+    {
+        TRACE( "coalescing event %d", pair.first );
+        return;
+    }
+    
+    auto& stats = Mill::current().stats();
+    
+    if ( !state->queue.push( pair ) )
+    {
+        TRACE( "queue full, dropping event %d", pair.first );
+        stats.dropped++;
+        return;
+    }
+    
+    TRACE( "queuing event %d", pair.first );
+    if ( state->queue.size() > stats.queued )
     {
-        TRACE( "queuing event %d", pair.first );
-        state->queue.push_back( pair );
+        stats.queued = state->queue.size();
     }
 }
 
 void Link::dispatch( Api::Call& call, Grain& grain )
 {
     ENTER();
-    try
+    
+    auto state = this->state( &call );
+    if ( state )
     {
-        auto& state = m_calls.at( &call );
-        TRACE( "found handler for call %s type %d", call.name.c_str(), state.type );
-        ( this->*state.handler )( grain );
+        TRACE( "found handler for call %s type %d", call.name.c_str(), state->type );
+        ( this->*state->handler )( grain );
     }
-    catch ( const std::out_of_range& e )
+    else
     {
         TRACE( "handler for call %s not found", call.name.c_str() );
     }
@@ -97,20 +148,24 @@ void Link::cleanup()
 {
     ENTER();
     
-    std::for_each( m_calls.begin(), m_calls.end(), [ & ]( Calls::value_type& value ) { value.second.queue.clear(); } );
+    std::for_each( m_calls.begin(), m_calls.end(), [ & ]( State& state ) { state.queue.clear(); } );
 }
 
 tau::Pair Link::get()
 {
-    auto& state  = m_calls.at( m_call );
-    auto pair = state.queue.back();
-    state.queue.pop_back();
+    auto state = this->state( m_call );
+    
+    tau::Pair pair;
+    if ( !state || !state->queue.pop( pair ) )
+    {
+        throw std::out_of_range( "no queued event" );
+    }
+    
     return pair;
 }
 
-void Wait::onIndex( const Main::Router& router, h::Table& table )
+void Wait::onMethods( h::Table& table ) const
 {
-    Link::onIndex( router, table );
     table.set( "errors", 1 );
 }
 
@@ -150,44 +205,44 @@ Runner* Wait::Joined::remove( Runner* runner )
     if ( i != map.end() )
     {
         runner = i->first;
-        i->second->deref();
+        Mill::current().wheel().cancel( i->second );
         map.erase( i );
     }
     
     return runner;
 }
 
-void Wait::Joined::add( base::Timer& timer, Runner& runner )
+void Wait::Joined::add( Runner& runner, long timeout )
 {
     wait.male( runner );
-    timer.setGrain( &runner );
-    map[ &runner ] = &timer;
-}
-
-void Wait::wait( h::Stack& stack )
-{
-    ENTER();
     
-    unsigned int type = Timeout;
-    if ( stack.top() )
+    auto& joined = map[ &runner ];
+    joined.wait = &wait;
+    joined.runner = &runner;
+    
+    auto& wheel = Mill::current().wheel();
+    if ( timeout < 0 )
     {
-        m_interval = parse( stack );
+        wheel.cancel( joined );
     }
     else
     {
-        type = Infinite ;
-        m_interval = Interval( Interval::Infinite );
+        wheel.arm( joined, timeout );
+        Mill::current().schedule( timeout );
     }
+}
+
+void Wait::wait( h::Stack& stack )
+{
+    ENTER();
     
-    auto timer = base::event( this, type )( &m_interval );
-    
-    m_joined.add( *timer, Api::runner() );
+    m_joined.add( Api::runner(), stack.top() ? parse( stack ) : -1 );
     Api::suspend();
     
     onWait();
 }
 
-Interval Wait::parse( h::Stack& stack ) const
+long Wait::parse( h::Stack& stack ) const
 {
     long seconds = 0;
     long micros = 0;
@@ -224,8 +279,10 @@ Interval Wait::parse( h::Stack& stack ) const
         seconds = stack.number();
     }
     
-    Interval interval( seconds, millis, micros );
-    return interval;
+    //
+    //  the wheel has millisecond resolution
+    //
+    return seconds * 1000 + millis + ( micros + 999 ) / 1000;
 }
 
 void Wait::onRunnerStop( Runner& runner )
@@ -238,25 +295,17 @@ void Wait::timer( Grain& grain )
 {
     auto& timer = dynamic_cast< base::Timer& >( grain );
         
-    switch ( timer.type() )
+    onTimer( timer );
+}
+
+void Wait::timeout( Runner& runner )
+{
+    m_joined.remove( &runner );
+    
+    if ( !onTimeout( runner ) )
     {
-        case Infinite:
-            return;
-            
-        case Timeout:
-        {
-            auto runner = dynamic_cast< Runner* >( timer.grain() );
-            if ( !onTimeout( *m_joined.remove( runner ) ) )
-            {
-                Api::error( lua::Exception( "timeout" ) );
-            }        
-        }
-        break;
-        
-        default:
-            onTimer( timer );
+        Api::error( lua::Exception( "timeout" ) );
     }
-            
 }
 
 unsigned int Wait::release( unsigned int count )
@@ -422,7 +471,7 @@ void Event::cleanup()
 }
 
 Net::Net(  )
-: m_read( 0 )
+: m_read( 0 ), m_pending( 0 ), m_corked( false ), m_closing( false ), m_datagram( -1 ), m_writable( NULL )
 {
     ENTER();
     
@@ -465,13 +514,324 @@ void Net::receive( h::Stack& stack )
 void Net::send( h::Stack& stack )
 {
     ENTER();
-//    net().awrite( stack.data() );
+    
+    auto chunk = Pile::chunk( stack );
+    send( chunk.data, chunk.length );
+}
+
+void Net::send( const char* data, unsigned int length )
+{
+    if ( !length )
+    {
+        return;
+    }
+    
+    if ( datagram() )
+    {
+        append( length );
+    }
+    else if ( m_out.empty() || m_out.back().capacity - m_out.back().length < length )
+    {
+        append( std::max< unsigned int >( length, NET_SEGMENT_SIZE ) );
+    }
+    
+    auto& segment = m_out.back();
+    memcpy( segment.data + segment.length, data, length );
+    segment.length += length;
+    m_pending += length;
+    
+    cork();
+}
+
+void Net::append( unsigned int size )
+{
+    Segment segment = { NULL, 0, 0, 0 };
+    segment.data = ( char* ) Slab::allocate( size, segment.capacity );
+    
+    m_out.push_back( segment );
 }
 
+void Net::clear( )
+{
+    for ( auto i = m_out.begin(); i != m_out.end(); i++ )
+    {
+        Slab::free( i->data, i->capacity );
+    }
+    
+    m_out.clear();
+    m_pending = 0;
+}
+
+//
+//  the flush runs on the next loop iteration, after the sends of the current one
+//
+void Net::cork( )
+{
+    if ( m_corked || m_writable )
+    {
+        return;
+    }
+    
+    m_corked = true;
+    Rock::ref();
+    base::event( this, Flush )( );
+}
+
+void Net::onTimer( base::Timer& timer )
+{
+    if ( timer.type() != Flush )
+    {
+        Tin::onTimer( timer );
+        return;
+    }
+    
+    timer.deref();
+    m_corked = false;
+    
+    try
+    {
+        flush();
+    }
+    catch( lua::Exception& e )
+    {
+        Api::error( e );
+    }
+    
+    Rock::deref();
+}
+
+void Net::flush( )
+{
+    ENTER();
+    
+    if ( m_writable )
+    {
+        return;
+    }
+    
+    struct iovec vector[ NET_IOVEC_MAX ];
+#ifdef __linux__
+    struct mmsghdr messages[ NET_IOVEC_MAX ];
+#endif
+    
+    while ( !m_out.empty() )
+    {
+        unsigned int count = 0;
+        unsigned long length = 0;
+        
+        for ( auto i = m_out.begin(); i != m_out.end() && count < NET_IOVEC_MAX; i++, count++ )
+        {
+            vector[ count ].iov_base = ( void* ) i->contents();
+            vector[ count ].iov_len = i->size();
+            length += i->size();
+        }
+        
+        long written = 0;
+        bool full = false;
+        
+        if ( datagram() )
+        {
+            //
+            //  every segment is a datagram of its own
+            //
+#ifdef __linux__
+            memset( messages, 0, sizeof( messages[ 0 ] ) * count );
+            for ( unsigned int i = 0; i < count; i++ )
+            {
+                messages[ i ].msg_hdr.msg_iov = &vector[ i ];
+                messages[ i ].msg_hdr.msg_iovlen = 1;
+            }
+            
+            int sent = ::sendmmsg( fd(), messages, count, MSG_NOSIGNAL );
+#else
+            //
+            //  without sendmmsg the datagrams go one sendmsg each, the ones sent before
+            //  a failure count as sent
+            //
+            int sent = 0;
+            for ( ; ( unsigned int ) sent < count; sent++ )
+            {
+                struct msghdr message;
+                memset( &message, 0, sizeof( message ) );
+                message.msg_iov = &vector[ sent ];
+                message.msg_iovlen = 1;
+                
+                if ( ::sendmsg( fd(), &message, MSG_NOSIGNAL ) < 0 )
+                {
+                    break;
+                }
+            }
+            
+            if ( !sent && count )
+            {
+                sent = -1;
+            }
+#endif
+            if ( sent < 0 )
+            {
+                written = -1;
+            }
+            
+            for ( int i = 0; i < sent; i++ )
+            {
+                written += vector[ i ].iov_len;
+            }
+            
+            full = sent >= 0 && ( unsigned int ) sent < count;
+        }
+        else
+        {
+            struct msghdr message;
+            memset( &message, 0, sizeof( message ) );
+            message.msg_iov = vector;
+            message.msg_iovlen = count;
+            
+            written = ::sendmsg( fd(), &message, MSG_NOSIGNAL );
+            full = written >= 0 && ( unsigned long ) written < length;
+        }
+        
+        if ( written < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            {
+                wait();
+                return;
+            }
+            
+            //
+            //  the queued bytes are dropped and the error reaches the runner like read errors do
+            //
+            auto error = errno;
+            TRACE( "error %d writing %lu bytes to %d", error, m_pending, fd() );
+            clear();
+            
+            throw lua::Exception( "error writing to %d: %s", fd(), strerror( error ) );
+        }
+        
+        consume( written );
+        
+        //
+        //  the socket buffer is full, the rest is written once it drains
+        //
+        if ( full )
+        {
+            wait();
+            return;
+        }
+    }
+    
+    if ( m_closing )
+    {
+        m_closing = false;
+        net().aclose();
+    }
+}
+
+void Net::wait( )
+{
+    if ( m_writable )
+    {
+        return;
+    }
+    
+    m_writable = event_new( Wake::base(), fd(), EV_WRITE, &Net::writableEvent, this );
+    Rock::ref();
+    event_add( m_writable, NULL );
+}
+
+void Net::writableEvent( int fd, short what, void* data )
+{
+    auto& net = *static_cast< Net* >( data );
+    
+    event_free( net.m_writable );
+    net.m_writable = NULL;
+    
+    try
+    {
+        net.flush();
+    }
+    catch( lua::Exception& e )
+    {
+        net.Api::error( e );
+    }
+    
+    net.Rock::deref();
+}
+
+void Net::consume( unsigned long length )
+{
+    m_pending -= length;
+    
+    while ( length )
+    {
+        auto& segment = m_out.front();
+        
+        if ( segment.size() > length )
+        {
+            segment.offset += length;
+            return;
+        }
+        
+        length -= segment.size();
+        Slab::free( segment.data, segment.capacity );
+        m_out.pop_front();
+    }
+}
+
+bool Net::datagram( )
+{
+    if ( m_datagram < 0 )
+    {
+        int type = 0;
+        socklen_t size = sizeof( type );
+        
+        m_datagram = !::getsockopt( fd(), SOL_SOCKET, SO_TYPE, &type, &size ) && type == SOCK_DGRAM;
+    }
+    
+    return m_datagram;
+}
+
+//
+//  the socket is closed once the queued bytes are written
+//
 void Net::close( )
 {
     ENTER();
-    net().aclose();
+    
+    m_closing = true;
+    flush();
+}
+
+void Net::cleanup( )
+{
+    ENTER();
+    
+    clear();
+    m_read = 0;
+    m_datagram = -1;
+    m_closing = false;
+    
+    auto writable = m_writable;
+    if ( writable )
+    {
+        event_free( writable );
+        m_writable = NULL;
+    }
+    
+    Tin::cleanup();
+    
+    //
+    //  the reference taken by wait is given back last, it can be the final one
+    //
+    if ( writable )
+    {
+        Rock::deref();
+    }
 }
 
 void Net::readEvent( Grain& ) 
@@ -484,7 +844,22 @@ void Net::readEvent( Grain& )
 void Net::find( h::Stack& stack )
 {
     ENTER();
-//    stack.push( net().input().find( stack.data() ) );
+    
+    auto chunk = Pile::chunk( stack );
+    unsigned int start = 0;
+    
+    if ( stack.type() == Number )
+    {
+        start = stack.integer();
+    }
+    
+    stack.push( find( chunk.data, chunk.length, start ) );
+}
+
+int Net::find( const char* data, unsigned int length, unsigned int start ) const
+{
+    auto& in = net().in();
+    return Search::find( in.contents(), in.length(), data, length, start );
 }
 
 void Net::resume( )
@@ -643,10 +1018,438 @@ void Flow::end( h::Stack& stack )
     }
 }
 
-void Flow::onIndex( const Main::Router& router, h::Table& table )
+void Flow::onIndex( const Main::Router& router, const lua::State& lua )
+{
+    m_reference = lua.reference();
+    Link::onIndex( router, lua );
+}
+
+__thread Channel::Ports* Channel::s_ports = NULL;
+
+Channel::Channel( )
+: m_port( NULL ), m_waiting( false )
+{
+    Api::method( "send", ( Tin::Method ) &Channel::send );
+    Api::method( "receive", ( Tin::Method ) &Channel::receive );
+    
+    Api::setName( "channel" );
+}
+
+Channel* Channel::get( const std::string& name )
 {
-    m_reference = table.reference();
-    Wait::onIndex( router, table );
+    auto channel = dynamic_cast< Channel* >( create() );
+    channel->open( name );
+    return channel;
+}
+
+Channel::Ports& Channel::ports( )
+{
+    if ( !s_ports )
+    {
+        s_ports = new Ports();
+    }
+    
+    return *s_ports;
+}
+
+void Channel::clear( unsigned int slot )
+{
+    if ( !s_ports )
+    {
+        return;
+    }
+    
+    for ( auto i = s_ports->begin(); i != s_ports->end(); i++ )
+    {
+        if ( i->second.subscribed )
+        {
+            i->second.hub.unsubscribe( slot );
+        }
+    }
+    
+    delete s_ports;
+    s_ports = NULL;
+}
+
+void Channel::open( const std::string& name )
+{
+    auto& ports = Channel::ports();
+    auto found = ports.find( name );
+    
+    if ( found == ports.end() )
+    {
+        found = ports.insert( Ports::value_type( name, Port( Hub::get( name ) ) ) ).first;
+    }
+    
+    m_port = &found->second;
+}
+
+void Channel::send( h::Stack& stack )
+{
+    ENTER();
+    
+    auto pill = new Pill();
+    if ( !stack.dump( *pill, types::Visited::Copy, true ) )
+    {
+        delete pill;
+        throw lua::Exception( "error dumping value" );
+    }
+    
+    if ( !m_port->hub.send( Mill::current().slot(), pill ) )
+    {
+        delete pill;
+        throw lua::Exception( "channel %s is full", m_port->hub.name.c_str() );
+    }
+}
+
+void Channel::receive( h::Stack& stack )
+{
+    ENTER();
+    
+    if ( !m_port->subscribed )
+    {
+        m_port->hub.subscribe( Mill::current().slot() );
+        m_port->subscribed = true;
+    }
+    
+    auto pill = m_port->receive();
+    if ( pill )
+    {
+        bool loaded = stack.load( *pill );
+        delete pill;
+        
+        if ( !loaded )
+        {
+            throw lua::Exception( "error loading message" );
+        }
+        
+        return;
+    }
+    
+    m_waiting = true;
+    m_port->waiting.push_back( this );
+    Tin::suspend();
+}
+
+void Channel::deliver( Pill* pill )
+{
+    ENTER();
+    
+    //
+    //  the message is loaded straight onto the stack and handed to the runner by reference
+    //
+    auto& lua = Main::get();
+    bool loaded = types::Value::load( *pill, lua );
+    delete pill;
+    
+    if ( !loaded )
+    {
+        Api::error( lua::Exception( "error loading message" ) );
+        return;
+    }
+    
+    auto reference = lua.reference();
+    lua.pop( 1 );
+    
+    h::Arguments arguments;
+    arguments.addReference( reference );
+    
+    Api::resume( &arguments );
+    lua.unref( reference );
+}
+
+void Channel::poll( )
+{
+    if ( !s_ports )
+    {
+        return;
+    }
+    
+    for ( auto i = s_ports->begin(); i != s_ports->end(); i++ )
+    {
+        auto& port = i->second;
+        
+        while ( !port.waiting.empty() )
+        {
+            auto pill = port.receive();
+            if ( !pill )
+            {
+                break;
+            }
+            
+            auto channel = port.waiting.front();
+            port.waiting.pop_front();
+            channel->m_waiting = false;
+            
+            channel->deliver( pill );
+        }
+    }
+}
+
+bool Channel::ready( )
+{
+    if ( !s_ports )
+    {
+        return false;
+    }
+    
+    auto slot = Mill::current().slot();
+    
+    for ( auto i = s_ports->begin(); i != s_ports->end(); i++ )
+    {
+        if ( !i->second.waiting.empty() && i->second.hub.ready( slot ) )
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void Channel::cleanup( )
+{
+    ENTER();
+    
+    if ( m_waiting )
+    {
+        m_port->waiting.remove( this );
+        m_waiting = false;
+    }
+    
+    m_port = NULL;
+    Tin::cleanup();
+}
+
+Pill* Channel::Port::receive( )
+{
+    auto pill = hub.receive( Mill::current().slot(), start );
+    start++;
+    
+    return pill;
+}
+
+Channel::Hub::Consumer::Consumer( )
+{
+    for ( unsigned int i = 0; i < VEGA_LINES_MAX; i++ )
+    {
+        producers[ i ] = NULL;
+    }
+}
+
+Channel::Hub::Hub( const std::string& _name )
+: name( _name ), subscribers( new Subscribers() ), orphans( 0 )
+{
+    for ( unsigned int i = 0; i <= VEGA_LINES_MAX; i++ )
+    {
+        consumers[ i ] = NULL;
+    }
+    
+    for ( unsigned int i = 0; i < VEGA_LINES_MAX; i++ )
+    {
+        cursors[ i ] = 0;
+    }
+    
+    consumers[ VEGA_LINES_MAX ] = new Consumer();
+}
+
+Channel::Hub& Channel::Hub::get( const std::string& name )
+{
+    static si::Lock lock;
+    static std::map< std::string, Hub* > hubs;
+    
+    si::Gate gate( lock );
+    
+    auto& hub = hubs[ name ];
+    if ( !hub )
+    {
+        hub = new Hub( name );
+    }
+    
+    return *hub;
+}
+
+void Channel::Hub::subscribe( unsigned int consumer )
+{
+    si::Gate gate( lock );
+    
+    Subscribers* current = subscribers;
+    for ( unsigned int i = 0; i < current->count; i++ )
+    {
+        if ( current->slots[ i ] == consumer )
+        {
+            return;
+        }
+    }
+    
+    if ( !consumers[ consumer ] )
+    {
+        consumers[ consumer ] = new Consumer();
+    }
+    
+    auto updated = new Subscribers( *current );
+    updated->slots[ updated->count++ ] = consumer;
+    
+    subscribers.store( updated, std::memory_order_release );
+    Rcu::retire( [ current ]( ) { delete current; } );
+}
+
+//
+//  called by the leaving line itself, its rings are drained once no sender can still
+//  see the old subscribers, messages left are sent again to the other subscribers or kept as orphans
+//
+void Channel::Hub::unsubscribe( unsigned int consumer )
+{
+    si::Gate gate( lock );
+    
+    Subscribers* current = subscribers;
+    auto updated = new Subscribers();
+    
+    for ( unsigned int i = 0; i < current->count; i++ )
+    {
+        if ( current->slots[ i ] != consumer )
+        {
+            updated->slots[ updated->count++ ] = current->slots[ i ];
+        }
+    }
+    
+    subscribers.store( updated, std::memory_order_release );
+    Rcu::retire( [ this, current, consumer ]( ) 
+    { 
+        delete current; 
+        drain( consumer );
+    } );
+}
+
+void Channel::Hub::drain( unsigned int consumer )
+{
+    Consumer* own = consumers[ consumer ];
+    Pill* pill = NULL;
+    
+    for ( unsigned int i = 0; own && i < VEGA_LINES_MAX; i++ )
+    {
+        Queue* queue = own->producers[ i ];
+        
+        while ( queue && queue->pop( pill ) )
+        {
+            if ( !send( consumer, pill ) )
+            {
+                delete pill;
+            }
+        }
+    }
+}
+
+Channel::Hub::Queue& Channel::Hub::queue( unsigned int consumer, unsigned int producer )
+{
+    auto& queue = ( ( Consumer* ) consumers[ consumer ] )->producers[ producer ];
+    
+    if ( !queue.load( std::memory_order_acquire ) )
+    {
+        si::Gate gate( lock );
+        
+        if ( !queue )
+        {
+            queue = new Queue();
+        }
+    }
+    
+    return *queue;
+}
+
+bool Channel::Hub::send( unsigned int producer, Pill* pill )
+{
+    Subscribers* current = subscribers.load( std::memory_order_acquire );
+    unsigned int count = current->count;
+    
+    if ( !count )
+    {
+        if ( queue( VEGA_LINES_MAX, producer ).push( pill ) )
+        {
+            orphans++;
+            return true;
+        }
+        
+        return false;
+    }
+    
+    auto& cursor = cursors[ producer ];
+    
+    for ( unsigned int i = 0; i < count; i++ )
+    {
+        unsigned int consumer = current->slots[ cursor++ % count ];
+        
+        if ( queue( consumer, producer ).push( pill ) )
+        {
+            Mill::wake( consumer );
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool Channel::Hub::ready( unsigned int consumer ) const
+{
+    Consumer* own = consumers[ consumer ];
+    auto lines = Mill::count();
+    
+    for ( unsigned int i = 0; own && i < lines; i++ )
+    {
+        Queue* queue = own->producers[ i ];
+        if ( queue && !queue->empty() )
+        {
+            return true;
+        }
+    }
+    
+    return orphans.load( std::memory_order_relaxed );
+}
+
+Pill* Channel::Hub::receive( unsigned int consumer, unsigned int start )
+{
+    Consumer* own = consumers[ consumer ];
+    auto lines = Mill::count();
+    Pill* pill = NULL;
+    
+    for ( unsigned int i = 0; own && i < lines; i++ )
+    {
+        Queue* queue = own->producers[ ( start + i ) % lines ];
+        if ( queue && queue->pop( pill ) )
+        {
+            return pill;
+        }
+    }
+    
+    if ( orphans.load( std::memory_order_relaxed ) )
+    {
+        pill = orphan( start );
+    }
+    
+    return pill;
+}
+
+Pill* Channel::Hub::orphan( unsigned int start )
+{
+    //
+    //  orphan rings can have several consumers, so they are only drained under the lock
+    //
+    si::Gate gate( lock );
+    
+    Consumer* orphans = consumers[ VEGA_LINES_MAX ];
+    auto lines = Mill::count();
+    Pill* pill = NULL;
+    
+    for ( unsigned int i = 0; i < lines; i++ )
+    {
+        Queue* queue = orphans->producers[ ( start + i ) % lines ];
+        if ( queue && queue->pop( pill ) )
+        {
+            this->orphans--;
+            return pill;
+        }
+    }
+    
+    return NULL;
 }
 
 Jet::Jet()
@@ -689,24 +1492,11 @@ void Jet::write( h::Stack& stack )
         throw lua::Exception( "expecting passed value" );
     }
 
-    if ( stack.type() == Table )
-    {
-        h::Table table = stack.table( );
-        void* data = table.data( "__instance" );
-
-        if ( data )
-        {
-            auto pile = dynamic_cast< Pile* >( Object::get( data ) );
-            //jet().push( pile->pill() );
-            return;
-        }
-        else
-        { 
-            throw lua::Exception( "expecting passed pile instance" );
-        }
-    }
-    
-    //jet().push( stack.data() );
+    //
+    //  tau does not take input for processes yet, the value is only checked to be 
+    //  a string or a pile
+    //
+    Pile::chunk( stack );
 }
 
 bool Jet::onProcess( const std::string& name, h::Stack& stack )
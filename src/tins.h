@@ -14,35 +14,39 @@ protected:
     {
     }
     
-    virtual void onIndex( const Main::Router& router, h::Table& table );
+    virtual void onIndex( const Main::Router& router, const lua::State& lua );
     virtual bool handle( unsigned int type, Grain& grain );
     virtual void cleanup();
     
     tau::Pair get();
     
 private:
+#define LINK_QUEUE_SIZE 16
+    
+    //
+    //  events of a call queued while its runner is elsewhere, in order of arrival
+    //
     struct State
     {
         unsigned int type;
         Handler handler;
-        tau::List queue;
+        Fifo< tau::Pair, LINK_QUEUE_SIZE > queue;
         
-        State( unsigned int _type, Handler _handler )
+        State( unsigned int _type = 0, Handler _handler = NULL )
         : type( _type ), handler( _handler )
         {
             
         }
-        
-        State( const State& state )
-        : type( state.type ), handler( state.handler ), queue( state.queue )
-        {
-            
-        }
     };
     
     void queue( const tau::Pair& pair );
-    typedef std::map< const Api::Call*, State > Calls;
     
+    //
+    //  states indexed by the dense call index, calls without an event have no type
+    //
+    typedef std::vector< State > Calls;
+    
+    State* state( const Api::Call* call );
     void dispatch( Api::Call& call, Grain& grain );
     
 private:
@@ -64,8 +68,8 @@ protected:
     unsigned int release( unsigned int count = 0 );
     
     virtual void cleanup();
-    Interval parse( h::Stack& ) const;
-    virtual void onIndex( const Main::Router& router, h::Table& table ); 
+    long parse( h::Stack& ) const;
+    virtual void onMethods( h::Table& table ) const;
     
 private:
     
@@ -82,6 +86,8 @@ private:
 
     virtual void onRunnerStop( Runner& );
     void timer( Grain& grain );
+    void timeout( Runner& runner );
+    
     enum Type
     {
         Timeout = 1,
@@ -108,9 +114,29 @@ private:
         runner.females().remove( *this );
     }
     
+    //
+    //  joined runners with their timeouts on the line wheel, 
+    //  the timeout lives in the map node so waiting does not allocate a timer
+    //
     struct Joined
     {
-        std::map< Runner*, base::Timer* > map;
+        struct Timeout: public Wheel::Timer
+        {
+            Wait* wait;
+            Runner* runner;
+            
+            Timeout( )
+            : wait( NULL ), runner( NULL )
+            {
+            }
+            
+            virtual void operator()( )
+            {
+                wait->timeout( *runner );
+            }
+        };
+        
+        std::unordered_map< Runner*, Timeout > map;
         Wait& wait;
         
         Joined( Wait& _wait )
@@ -121,7 +147,11 @@ private:
         void clear();
         
         Runner* remove( Runner* runner = NULL );
-        void add( base::Timer& timer, Runner& runner );
+        
+        //
+        //  negative timeout waits infinitely
+        //
+        void add( Runner& runner, long timeout );
         unsigned int size() const
         {
             return map.size();
@@ -131,7 +161,6 @@ private:
     
 private:
     Joined m_joined;
-    Interval m_interval;
 };
 
 class Tin: public Wait, public Rock
@@ -151,6 +180,14 @@ public:
         return typeid( Tin ).hash_code();
     }
     
+    //
+    //  the base is gone once the tin was closed or cleaned up
+    //
+    bool closed( ) const
+    {
+        return !m_base;
+    }
+    
 protected:    
     Tin( base::Base* base = NULL );
     base::Base& base()
@@ -179,9 +216,10 @@ protected:
         cleanup();
     }
     
+    virtual void onTimer( base::Timer& );
+    
 private:    
     virtual bool handle( unsigned int type, Grain& grain );
-    virtual void onTimer( base::Timer& );
     virtual void gc()
     {
         Rock::deref();
@@ -233,6 +271,9 @@ private:
     unsigned int m_count;
 };
 
+#define NET_SEGMENT_SIZE 4096
+#define NET_IOVEC_MAX 64
+
 class Net: public Tin
 {
 public:
@@ -242,11 +283,40 @@ public:
     }
     
     void close();
+    virtual void cleanup();
+    
+    //
+    //  queues the bytes, all the sends of a loop iteration go out with one syscall
+    //
+    void send( const char* data, unsigned int length );
+    
+    //
+    //  bytes queued and not yet written
+    //
+    unsigned long pending() const
+    {
+        return m_pending;
+    }
     static Grain* create()
     {
         return Tin::create( typeid( Net ), [](){ return new Net(); } );
     }
     
+    unsigned int length() const
+    {
+        return net().in().length();
+    }
+    
+    //
+    //  position of the bytes in the received ones at or after start or -1
+    //
+    int find( const char* data, unsigned int length, unsigned int start = 0 ) const;
+    
+    int fd()
+    {
+        return net().fd();
+    }
+    
 private:
     virtual unsigned int hash() const
     {
@@ -264,9 +334,9 @@ private:
         return dynamic_cast< const tau::base::Net& >( Tin::base() );
     }
     
-    unsigned int length() const
+    virtual const char* exports( ) const
     {
-        return net().in().length();
+        return "net";
     }
     
     void id( h::Stack& stack );
@@ -289,8 +359,58 @@ private:
     
     void resume( );
     
+    enum Events
+    {
+        Flush = 1
+    };
+    
+    //
+    //  slab block of the outbound chain, bytes before offset were already written
+    //
+    struct Segment
+    {
+        char* data;
+        unsigned int offset;
+        unsigned int length;
+        unsigned int capacity;
+        
+        const char* contents() const
+        {
+            return data + offset;
+        }
+        
+        unsigned int size() const
+        {
+            return length - offset;
+        }
+    };
+    
+    virtual void onTimer( base::Timer& timer );
+    void append( unsigned int size );
+    void clear( );
+    void cork( );
+    void flush( );
+    
+    //
+    //  the rest of the chain is flushed when the socket is writable again
+    //
+    void wait( );
+    static void writableEvent( int fd, short what, void* data );
+    void consume( unsigned long length );
+    bool datagram( );
+    
 private:
     unsigned int m_read;
+    
+    //
+    //  outbound chain, small writes share a segment, datagrams always get their own
+    //
+    std::deque< Segment > m_out;
+    unsigned long m_pending;
+    bool m_corked;
+    bool m_closing;
+    int m_datagram;
+    struct event* m_writable;
 };
 
 
@@ -320,7 +440,7 @@ private:
     void end( h::Stack& );  
 
     virtual bool onTimeout( Runner& );
-    virtual void onIndex( const Main::Router& router, h::Table& table );
+    virtual void onIndex( const Main::Router& router, const lua::State& lua );
     
     virtual void onRunnerStop( Runner& );
     
@@ -336,6 +456,132 @@ private:
     Runner* m_used;
 };
 
+class Channel: public Tin
+{
+public:
+    Channel( );
+    virtual ~Channel()
+    {
+        ENTER();
+    }
+    
+    static Grain* create()
+    {
+        return Tin::create( typeid( Channel ), [](){ return new Channel(); } );
+    }
+    
+    static Channel* get( const std::string& name );
+    static void poll( );
+    
+    //
+    //  a waiting channel of the line has a message to deliver
+    //
+    static bool ready( );
+    
+    //
+    //  the line in slot is leaving, its subscriptions are dropped
+    //
+    static void clear( unsigned int slot );
+    
+private:
+    virtual unsigned int hash( ) const
+    {
+        return typeid ( *this ).hash_code( );
+    }
+    
+    void send( h::Stack& );
+    void receive( h::Stack& );
+    
+    virtual void cleanup();
+    void open( const std::string& name );
+    void deliver( Pill* pill );
+    
+#define CHANNEL_CAPACITY 1024
+    
+    //
+    //  process wide state of a named channel, there is a ring for every pair of producer and consumer lines
+    //  and messages sent before any line started receiving are kept as orphans
+    //
+    struct Hub
+    {
+        typedef Ring< Pill*, CHANNEL_CAPACITY > Queue;
+        
+        struct Consumer
+        {
+            std::atomic< Queue* > producers[ VEGA_LINES_MAX ];
+            
+            Consumer( );
+        };
+        
+        //
+        //  copied and published again on every change, senders read it without the lock
+        //  and old copies are retired through Rcu
+        //
+        struct Subscribers
+        {
+            unsigned int count;
+            unsigned int slots[ VEGA_LINES_MAX ];
+            
+            Subscribers( )
+            : count( 0 )
+            {
+            }
+        };
+        
+        std::string name;
+        std::atomic< Consumer* > consumers[ VEGA_LINES_MAX + 1 ];
+        std::atomic< Subscribers* > subscribers;
+        std::atomic< unsigned int > orphans;
+        si::Lock lock;
+        
+        //
+        //  round robin position of every producer line, only used by that line
+        //
+        unsigned int cursors[ VEGA_LINES_MAX ];
+        
+        Hub( const std::string& name );
+        
+        void subscribe( unsigned int consumer );
+        void unsubscribe( unsigned int consumer );
+        bool send( unsigned int producer, Pill* pill );
+        bool ready( unsigned int consumer ) const;
+        Pill* receive( unsigned int consumer, unsigned int start );
+        
+        static Hub& get( const std::string& name );
+        
+    private:
+        Queue& queue( unsigned int consumer, unsigned int producer );
+        Pill* orphan( unsigned int start );
+        void drain( unsigned int consumer );
+    };
+    
+    //
+    //  line local end of a channel
+    //
+    struct Port
+    {
+        Hub& hub;
+        bool subscribed;
+        unsigned int start;
+        std::list< Channel* > waiting;
+        
+        Port( Hub& _hub )
+        : hub( _hub ), subscribed( false ), start( 0 )
+        {
+        }
+        
+        Pill* receive( );
+    };
+    
+    typedef std::map< std::string, Port > Ports;
+    static Ports& ports( );
+    
+private:
+    Port* m_port;
+    bool m_waiting;
+    static __thread Ports* s_ports;
+};
+
 class Jet: public Tin
 {
 public:
@@ -0,0 +1,93 @@
+#include "wake.h"
+
+#include <tau/liner.h>
+#include <event2/event.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#else
+#include <fcntl.h>
+#endif
+
+Wake::Wake( const Callback& callback )
+: m_callback( callback ), m_event( NULL )
+{
+#ifdef __linux__
+    m_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    m_write = m_fd;
+#else
+    //
+    //  a non blocking pipe elsewhere, rings on a full pipe are already pending
+    //
+    int fds[ 2 ] = { -1, -1 };
+    if ( !pipe( fds ) )
+    {
+        for ( unsigned int i = 0; i < 2; i++ )
+        {
+            fcntl( fds[ i ], F_SETFL, fcntl( fds[ i ], F_GETFL ) | O_NONBLOCK );
+            fcntl( fds[ i ], F_SETFD, FD_CLOEXEC );
+        }
+    }
+    
+    m_fd = fds[ 0 ];
+    m_write = fds[ 1 ];
+#endif
+    assert( m_fd >= 0 );
+    
+    m_event = event_new( base(), m_fd, EV_READ | EV_PERSIST, &Wake::onEvent, this );
+    event_add( m_event, NULL );
+}
+
+Wake::~Wake( )
+{
+    close();
+    ::close( m_fd );
+    
+    if ( m_write != m_fd )
+    {
+        ::close( m_write );
+    }
+}
+
+struct event_base* Wake::base( )
+{
+    return static_cast< struct event_base* >( tau::line().base() );
+}
+
+void Wake::close( )
+{
+    if ( m_event )
+    {
+        event_free( m_event );
+        m_event = NULL;
+    }
+}
+
+void Wake::ring( )
+{
+#ifdef __linux__
+    eventfd_write( m_write, 1 );
+#else
+    char byte = 1;
+    if ( ::write( m_write, &byte, 1 ) < 0 )
+    {
+        return;
+    }
+#endif
+}
+
+void Wake::onEvent( int fd, short what, void* data )
+{
+#ifdef __linux__
+    eventfd_t count = 0;
+    eventfd_read( fd, &count );
+#else
+    char bytes[ 64 ];
+    while ( ::read( fd, bytes, sizeof( bytes ) ) > 0 )
+    {
+    }
+#endif
+    
+    static_cast< Wake* >( data )->m_callback();
+}
@@ -0,0 +1,52 @@
+#ifndef VEGA_WAKE_H
+#define	VEGA_WAKE_H
+
+#include "common.h"
+
+#include <functional>
+
+struct event;
+struct event_base;
+
+//
+//  eventfd, or a pipe where there is none, watched by the loop of the line that created it, any line can ring it 
+//  to run the callback on the owning line
+//
+class Wake
+{
+public:
+    typedef std::function< void( ) > Callback;
+    
+    Wake( const Callback& callback );
+    ~Wake( );
+    
+    //
+    //  can be called from any line
+    //
+    void ring( );
+    
+    //
+    //  stops watching the fd while the loop still exists, later rings are ignored
+    //
+    void close( );
+    
+    //
+    //  event base tau runs the loop of the current line on
+    //
+    static struct event_base* base( );
+    
+private:
+    static void onEvent( int fd, short what, void* data );
+    
+private:
+    Callback m_callback;
+    int m_fd;
+    
+    //
+    //  end rings write to, the eventfd itself or the write end of the pipe
+    //
+    int m_write;
+    struct event* m_event;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "wheel.h"
+
+#include <algorithm>
+
+Wheel::Wheel( )
+: m_now( clock() ), m_size( 0 )
+{
+    memset( m_slots, 0, sizeof( m_slots ) );
+}
+
+unsigned long Wheel::clock( )
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast< std::chrono::milliseconds >( now ).count();
+}
+
+void Wheel::arm( Timer& timer, unsigned long delay, unsigned long period )
+{
+    if ( timer.armed() )
+    {
+        cancel( timer );
+    }
+    
+    //
+    //  the wheel is only advanced when the line ticks, delays count from the clock,
+    //  which is never behind the current slot that was already fired
+    //
+    timer.expires = std::max( clock(), m_now ) + std::max< unsigned long >( delay, 1 );
+    timer.period = period;
+    
+    insert( timer );
+    m_size++;
+}
+
+void Wheel::cancel( Timer& timer )
+{
+    if ( timer.armed() )
+    {
+        unlink( timer );
+        m_size--;
+    }
+}
+
+void Wheel::insert( Timer& timer )
+{
+    auto delta = timer.expires - m_now;
+    
+    unsigned int level = 0;
+    while ( level < WHEEL_LEVELS - 1 && delta >= ( 1UL << ( WHEEL_BITS * ( level + 1 ) ) ) )
+    {
+        level++;
+    }
+    
+    //
+    //  timers further than the wheel covers are parked in the last level and cascaded again
+    //
+    auto expires = std::min( timer.expires, m_now + ( 1UL << ( WHEEL_BITS * WHEEL_LEVELS ) ) - 1 );
+    auto& slot = m_slots[ level ][ ( expires >> ( WHEEL_BITS * level ) ) & ( WHEEL_SLOTS - 1 ) ];
+    
+    timer.next = slot;
+    timer.prev = &slot;
+    
+    if ( slot )
+    {
+        slot->prev = &timer.next;
+    }
+    
+    slot = &timer;
+}
+
+void Wheel::unlink( Timer& timer )
+{
+    *timer.prev = timer.next;
+    
+    if ( timer.next )
+    {
+        timer.next->prev = timer.prev;
+    }
+    
+    timer.next = NULL;
+    timer.prev = NULL;
+}
+
+void Wheel::cascade( unsigned int level )
+{
+    auto& slot = m_slots[ level ][ ( m_now >> ( WHEEL_BITS * level ) ) & ( WHEEL_SLOTS - 1 ) ];
+    
+    while ( slot )
+    {
+        auto& timer = *slot;
+        unlink( timer );
+        insert( timer );
+    }
+}
+
+void Wheel::advance( unsigned long time )
+{
+    while ( m_now < time )
+    {
+        if ( !m_size )
+        {
+            m_now = time;
+            break;
+        }
+        
+        //
+        //  idle stretches are skipped up to the next time a timer fires or a slot cascades
+        //
+        auto next = this->next();
+        if ( next > time )
+        {
+            m_now = time;
+            break;
+        }
+        
+        m_now = std::max( m_now + 1, next );
+        
+        for ( unsigned int level = 1; level < WHEEL_LEVELS; level++ )
+        {
+            if ( m_now & ( ( 1UL << ( WHEEL_BITS * level ) ) - 1 ) )
+            {
+                break;
+            }
+            
+            cascade( level );
+        }
+        
+        auto& slot = m_slots[ 0 ][ m_now & ( WHEEL_SLOTS - 1 ) ];
+        
+        while ( slot )
+        {
+            auto& timer = *slot;
+            unlink( timer );
+            
+            if ( timer.period )
+            {
+                timer.expires += timer.period;
+                insert( timer );
+            }
+            else
+            {
+                m_size--;
+            }
+            
+            timer();
+        }
+    }
+}
+
+unsigned long Wheel::next( ) const
+{
+    if ( !m_size )
+    {
+        return 0;
+    }
+    
+    unsigned long next = 0;
+    
+    for ( unsigned int level = 0; level < WHEEL_LEVELS; level++ )
+    {
+        auto shift = WHEEL_BITS * level;
+        auto current = m_now >> shift;
+        
+        //
+        //  a level holds at most one turn of it, a timer a whole turn ahead of the current 
+        //  position of a higher level is in the current slot and cascades last
+        //
+        for ( unsigned long i = 1; i <= WHEEL_SLOTS; i++ )
+        {
+            if ( m_slots[ level ][ ( current + i ) & ( WHEEL_SLOTS - 1 ) ] )
+            {
+                auto time = ( current + i ) << shift;
+                if ( !next || time < next )
+                {
+                    next = time;
+                }
+                
+                break;
+            }
+        }
+    }
+    
+    return next;
+}
@@ -0,0 +1,89 @@
+#ifndef VEGA_WHEEL_H
+#define	VEGA_WHEEL_H
+
+#include "common.h"
+
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS ( 1 << WHEEL_BITS )
+#define WHEEL_LEVELS 4
+
+//
+//  hierarchical timing wheel of a line with millisecond resolution, 
+//  timers are intrusive so arming and cancelling does not allocate and takes constant time
+//
+class Wheel
+{
+public:
+    struct Timer
+    {
+        Timer* next;
+        Timer** prev;
+        unsigned long expires;
+        unsigned long period;
+        
+        Timer( )
+        : next( NULL ), prev( NULL ), expires( 0 ), period( 0 )
+        {
+        }
+        
+        virtual ~Timer( )
+        {
+        }
+        
+        bool armed( ) const
+        {
+            return prev;
+        }
+        
+        //
+        //  called when the timer expires, a timer that is not periodic can be destroyed here
+        //
+        virtual void operator()( ) = 0;
+    };
+    
+    Wheel( );
+    
+    //
+    //  fires the timer in delay milliseconds, and then every period milliseconds
+    //  counted from the previous expiration so periodic timers do not drift
+    //
+    void arm( Timer& timer, unsigned long delay, unsigned long period = 0 );
+    void cancel( Timer& timer );
+    
+    //
+    //  fires all the timers expired by time
+    //
+    void advance( unsigned long time );
+    
+    //
+    //  time advance has to run at next, for a timer to fire or a slot to cascade, or 0 without timers
+    //
+    unsigned long next( ) const;
+    
+    unsigned long now( ) const
+    {
+        return m_now;
+    }
+    
+    unsigned int size( ) const
+    {
+        return m_size;
+    }
+    
+    //
+    //  monotonic time in milliseconds
+    //
+    static unsigned long clock( );
+    
+private:
+    void insert( Timer& timer );
+    void unlink( Timer& timer );
+    void cascade( unsigned int level );
+    
+private:
+    Timer* m_slots[ WHEEL_LEVELS ][ WHEEL_SLOTS ];
+    unsigned long m_now;
+    unsigned int m_size;
+};
+
+#endif
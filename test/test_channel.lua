@@ -48,3 +48,52 @@ Udp({count=10})
 
 
 
+
+local Channel = class(common.Test)
+
+function Channel:testReceive()
+    local channel = can.channel('local')
+    channel:send({key='value'})
+    assert(channel:receive().key == 'value')
+    
+    -- fields set on an object sit in front of its methods
+    assert(channel.name == 'local')
+    channel.tag = 1
+    channel:send('again')
+    assert(channel:receive() == 'again' and channel.tag == 1)
+end
+
+function Channel:testLines()
+    local channel = can.channel('lines')
+    
+    run{function() 
+        require('vega.can').channel('lines'):send('message') 
+    end, line='any'}
+    
+    assert(channel:receive() == 'message')
+end
+
+function Channel:testFunctions()
+    local channel = can.channel('functions')
+    local prototypes = can.info().total.prototypes
+    
+    for i = 1, 100 do
+        channel:send(function(x) return x + i end)
+    end
+    
+    -- the code is kept once whatever the upvalues
+    assert(can.info().total.prototypes == prototypes + 1)
+    
+    for i = 1, 100 do
+        assert(channel:receive()(1) == i + 1)
+    end
+    
+    local double = function(x) return x * 2 end
+    channel:send(double)
+    channel:send(double)
+    
+    local first, second = channel:receive(), channel:receive()
+    assert(first(2) == 4 and second(2) == 4)
+end
+
+Channel()
@@ -0,0 +1,38 @@
+local can = require 'vega.can'
+local dict = require 'vega.dict'
+local common = require 'common'
+
+local Dict = class(common.Test)
+
+function Dict:testSet()
+    dict.set('key', 'value')
+    assert(dict.get('key') == 'value')
+    
+    dict.set('key', 'changed')
+    assert(dict.get('key') == 'changed')
+    
+    dict.remove('key')
+    assert(not dict.get('key'))
+end
+
+function Dict:testKeys()
+    for i = 1, 100 do
+        dict.set('key' .. i, tostring(i))
+    end
+    
+    assert(#dict.keys() >= 100)
+    assert(dict.get('key50') == '50')
+end
+
+function Dict:testLines()
+    dict.set('line', 'value')
+    local channel = can.channel('dict')
+    
+    run{function()
+        require('vega.can').channel('dict'):send(require('vega.dict').get('line'))
+    end, line='any'}
+    
+    assert(channel:receive() == 'value')
+end
+
+Dict()
@@ -27,4 +27,193 @@ function Dump:testLoad()
     assert(can.compare(self, self))
 end
 
+function Dump:testArray()
+    local array = {}
+    for i = 1, 10000 do
+        array[i] = i % 3 == 0 and i / 4 or i % 3 == 1 and tostring(i) or i % 2 == 0
+    end
+    
+    array.name = 'array'
+    array[0] = 'zero'
+    array[20000] = {1, 2, {x = -1.5}}
+    
+    local loaded = can.load(can.dump(array))
+    assert(#loaded == #array)
+    
+    for i = 1, #array do
+        assert(loaded[i] == array[i])
+    end
+    
+    assert(loaded.name == 'array' and loaded[0] == 'zero')
+    assert(loaded[20000][3].x == -1.5)
+    assert(can.compare(array, loaded))
+    
+    loaded[5000] = false
+    assert(not can.compare(array, loaded))
+end
+
+function Dump:testEncoding()
+    local numbers = {0, 127, 128, -1, -300, 2^40, -2^52, 0.1, -1.5, 1e300}
+    local loaded = can.load(can.dump(numbers))
+    
+    for i = 1, #numbers do
+        assert(loaded[i] == numbers[i])
+    end
+    
+    assert(can.load(can.dump(0.25)) == 0.25)
+    
+    -- repeated keys are written once
+    local records = {}
+    for i = 1, 1000 do
+        records[i] = {id = i, ok = true}
+    end
+    
+    local dump = can.dump(records)
+    assert(#dump < 16 * #records)
+    
+    loaded = can.load(dump)
+    assert(loaded[1000].id == 1000 and loaded[1000].ok)    
+    -- a version 1 dump, which had fixed size little endian fields and integer numbers:
+    -- {n = 42, neg = -7, yes = true, no = false, s = 'text', t = {'a'}, f = function(x) return x * 2 end}
+    -- with the metatable {__index = {k = 'v'}}
+    local v1 = '\1\0\0\0\190\0\0\0\5\7\0\0\0\4\1\0\0\0\110\3\42\0\0\0\0\0\0\0\4\3\0\0\0\110\101\103\3'
+        .. '\249\255\255\255\255\255\255\255\4\3\0\0\0\121\101\115\1\1\0\0\0\0\0\0\0\4\2\0\0\0\110'
+        .. '\111\1\0\0\0\0\0\0\0\0\4\1\0\0\0\115\4\4\0\0\0\116\101\120\116\4\1\0\0\0\116\5\1\0\0\0\3'
+        .. '\1\0\0\0\0\0\0\0\4\1\0\0\0\97\0\4\1\0\0\0\102\6\27\0\0\0\27\76\74\1\2\20\2\0\2\0\0\1\3'
+        .. '\67\0\0\2\22\1\0\0\72\1\2\0\4\0\0\0\0\0\5\1\0\0\0\4\7\0\0\0\95\95\105\110\100\101\120\5'
+        .. '\1\0\0\0\4\1\0\0\0\107\4\1\0\0\0\118\0\0'
+    
+    loaded = can.load(v1)
+    assert(loaded.n == 42 and loaded.neg == -7 and loaded.yes == true and loaded.no == false)
+    assert(loaded.s == 'text' and loaded.t[1] == 'a' and loaded.f(2) == 4)
+    assert(getmetatable(loaded).__index.k == 'v' and loaded.k == 'v')
+end
+
+function Dump:testShared()
+    local shared = {value = 1}
+    local object = {first = shared, second = shared, nested = {shared}}
+    object.nested.parent = object
+    
+    local copy = can.load(can.dump(object))
+    assert(copy.first.value == 1 and copy.second.value == 1 and copy.nested[1].value == 1)
+    assert(not copy.nested.parent)
+    
+    local once = can.load(can.dump(object, 'once'))
+    local count = (once.first and 1 or 0) + (once.second and 1 or 0) + (once.nested[1] and 1 or 0)
+    assert(count == 1)
+    
+    assert(not pcall(can.dump, object, 'error'))
+    assert(can.load(can.dump({shared}, 'error'))[1].value == 1)
+    
+    -- metatables are dumped for every table using them whatever the policy
+    local mt = {kind = 'point'}
+    local points = can.load(can.dump({setmetatable({}, mt), setmetatable({}, mt)}, 'once'))
+    assert(getmetatable(points[1]).kind == 'point' and getmetatable(points[2]).kind == 'point')
+end
+
+function Dump:testSkipped()
+    local pile = can.pile()
+    local object = {1, 2, pile, 4, [pile] = 'key', value = pile, name = 'object'}
+    
+    for i = 1, 200 do
+        object['field' .. i] = i
+    end
+    
+    local loaded = can.load(can.dump(object))
+    assert(loaded[1] == 1 and loaded[2] == 2 and not loaded[3] and loaded[4] == 4)
+    assert(not loaded.value and loaded.name == 'object' and loaded.field200 == 200)
+    
+    local count = 0
+    for _ in pairs(loaded) do
+        count = count + 1
+    end
+    
+    assert(count == 204)
+    
+    -- userdata not made by vega is not taken for a vega object
+    assert(not pcall(can.dump, io.stdout))
+    
+    -- values that cannot be digested are an error rather than unequal
+    assert(not pcall(can.compare, pile, pile))    
+    -- nesting past the depth limit fails the dump instead of the C stack
+    local nested = {}
+    local inner = nested
+    for i = 1, 100000 do
+        inner.next = {}
+        inner = inner.next
+    end
+    
+    assert(not pcall(can.dump, nested))
+    assert(not pcall(can.digest, nested))
+end
+
+function Dump:testDigest()
+    local left, right = {}, {}
+    for i = 1, 100 do
+        left['key' .. i] = {i, -0.0}
+        right['key' .. (101 - i)] = {101 - i, 0}
+    end
+    
+    assert(#can.digest(left) == 32)
+    assert(can.digest(left) == can.digest(right))
+    assert(can.compare(left, right))
+    
+    right.key50[1] = 'changed'
+    assert(can.digest(left) ~= can.digest(right))
+    assert(not can.compare(left, right))
+    assert(can.digest(self) == can.digest(can.load(can.dump(self))))
+end
+
+function Dump:testStream()
+    local records = {}
+    for i = 1, 100 do
+        records[i] = {id = i, name = 'record ' .. i, tags = {'a', 'b'}}
+    end
+    
+    local dump = can.dump(records) .. can.dump('next') .. can.dump(self)
+    local loader = can.loader()
+    
+    for i = 1, #dump, 7 do
+        loader:write(dump:sub(i, i + 6))
+        assert(loader:length() < 3 or i + 7 > #dump)
+    end
+    
+    assert(loader:length() == 3)
+    assert(can.compare(loader:read(), records))
+    assert(loader:read() == 'next')
+    assert(loader:read():__id())
+    assert(loader:length() == 0 and loader:read() == nil)
+    
+    local _, error = pcall(function() loader:write('not a dump') end)
+    assert(error)
+end
+
+function Dump:testShapes()
+    -- records with the same keys share them whatever order they were built in
+    local records = {}
+    for i = 1, 1000 do
+        if i % 2 == 0 then
+            records[i] = {flag = true, done = false, count = i}
+        else
+            records[i] = {count = i, done = false, flag = true}
+        end
+    end
+    
+    records[10].extra = 'extra'
+    records[20].count = can.pile()
+    
+    local dump = can.dump(records)
+    assert(#dump < 10 * #records)
+    
+    local loaded = can.load(dump)
+    assert(loaded[10].extra == 'extra' and loaded[20].count == nil and loaded[20].flag)
+    
+    records[20].count = nil
+    assert(can.compare(loaded, records))
+    
+    local loader = can.loader()
+    loader:write(dump)
+    assert(can.compare(loader:read(), records))
+end
+
 Dump()
@@ -35,4 +35,80 @@ function Flow:testTimeout()
     assert(error)
 end
 
+function Flow:testSpawn()
+    local line = run{function() sleep{msec=10} end, line='any'}
+    assert(type(line) == 'number')
+    
+    assert(run{function() end, line=can.info().line} == can.info().line)
+end
+
+function Flow:testInfo()
+    local event = event()
+    run(function() event:wait() end)
+    
+    local info = can.info()
+    assert(info.load.line == info.line)
+    assert(info.load.runners > 0 and info.load.suspended > 0)
+    assert(info.total.lines == #info.lines)
+    assert(info.total.runners >= info.load.runners)
+    assert(info.total.buffers >= 0 and info.total.cached >= 0)
+    assert(info.load.memory >= 0 and info.load.loops >= 0)
+    
+    event:set()
+end
+
+function Flow:testSleeps()
+    local done = event()
+    local woken = {}
+    
+    for i = 1, 10 do
+        run(function() 
+            sleep{msec=(11 - i) * 5} 
+            table.insert(woken, i) 
+            
+            if #woken == 10 then
+                done:set()
+            end
+        end)
+    end
+    
+    done:wait()
+    
+    for i = 1, 10 do
+        assert(woken[i] == 11 - i)
+    end
+end
+
+function Flow:testWakeups()
+    local ready = event()
+    local done = event()
+    local woken = 0
+    
+    for i = 1, 1000 do
+        run(function() 
+            ready:wait() 
+            woken = woken + 1 
+            
+            if woken == 1000 then
+                done:set()
+            end
+        end)
+    end
+    
+    ready:set(1000)
+    done:wait()
+    
+    assert(woken == 1000)
+end
+
+function Flow:testObject()
+    local first, second = event(), event()
+    assert(type(first) == 'userdata')
+    assert(getmetatable(first) == getmetatable(second))
+    
+    first:set()
+    first:wait()
+    assert(first.errors)
+end
+
 Flow()
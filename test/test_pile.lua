@@ -0,0 +1,82 @@
+local can = require 'vega.can'
+local common = require 'common'
+
+local Pile = class(common.Test)
+
+function Pile:testPile()
+    local pile = can.pile()
+    pile:write("first ")
+    pile:write("second")
+    
+    assert(pile:length() == 12)
+    assert(pile:read() == "first second")
+end
+
+function Pile:testLoop()
+    local pile = can.pile()
+    for i = 1, 1000 do
+        pile:write("x")
+        assert(pile:length() == i)
+    end
+    
+    for i = 1, 1000 do
+        local value = can.number(10)
+        assert(value >= 0 and value < 10)
+    end
+end
+
+function Pile:testView()
+    local pile = can.pile()
+    pile:write("header:body")
+    
+    local slice = pile:slice(7, 4)
+    assert(slice:length() == 4)
+    assert(slice:find("dy") == 2)
+    
+    local view = pile:view()
+    assert(view:length() == 11)
+    assert(view:read(7) == "header:")
+    assert(view:read() == "body")
+    
+    assert(pile:length() == 11)
+    assert(not pcall(function() slice:write("x") end))
+    
+    local copy = can.pile()
+    copy:write(slice)
+    assert(copy:read() == "body")
+    assert(can.load(can.dump(slice)) == "body")
+    
+    -- reading the source keeps the bytes of its views
+    local head = pile:slice(0, 6)
+    assert(pile:read() == "header:body" and pile:length() == 0)
+    assert(head:read() == "header" and slice:read() == "body")
+    
+    pile:write("next")
+    assert(pile:read() == "next")
+    
+    assert(not pcall(function() pile:slice(-1) end))
+    assert(not pcall(function() pile:slice(0, -1) end))
+end
+
+function Pile:testFind()
+    local pile = can.pile()
+    local head = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    pile:write(head .. string.rep("x", 100) .. "\r\n\r\n")
+    
+    local found = pile:find("\r\n\r\n")
+    assert(found == #head - 4)
+    assert(pile:find("\r\n\r\n", found + 1) == #head + 100)
+    assert(pile:find("\r\n\r\n", #head + 101) == -1)
+    assert(pile:find("missing") == -1)
+    assert(pile:find("") == 0)
+    
+    local delimiter = can.pile()
+    delimiter:write("Host")
+    assert(pile:find(delimiter) == head:find("Host") - 1)
+    
+    -- methods called on something else than a pile fail instead of reaching C
+    assert(not pcall(pile.find, newproxy(true), "Host"))
+    assert(not pcall(pile.length, io.stdout))
+end
+
+Pile()
@@ -0,0 +1,26 @@
+local can = require 'vega.can'
+local common = require 'common'
+local io = require 'vega.io'
+
+local Shard = class(common.Test)
+
+function Shard:testAccept()
+    local port = can.number(1000) + 13000
+    local greeting = 'line '
+    
+    local listener = can.listener{shard=true, port=port, accept=function(net)
+        net:send(greeting .. require('vega.can').info().line)
+        net:close()
+    end}
+    
+    for i = 1, 10 do
+        local net = io.tcp{host='localhost', port=port}
+        local reply = net:read()
+        
+        assert(reply:sub(1, #greeting) == greeting)
+    end
+    
+    listener:close()
+end
+
+Shard()
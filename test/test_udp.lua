@@ -44,6 +44,36 @@ function Udp:testSend()
     until self.count == 0
 end
 
+-- sends of one loop iteration go out together but stay separate datagrams
+function Udp:testBurst()
+    local host = 'localhost'
+    local port = can.number(1000) + 12000
+    local count = 5
+    
+    local received = {}
+    local done = flow.event()
+    
+    local listener = can.listener({type='udp', host=host, port=port})
+    flow(function()
+        for i = 1, count do
+            received[i] = listener:accept():data()
+        end
+        done:set()
+    end)
+    
+    local udp = can.udp(host .. ':' .. port)
+    local strings = {}
+    for i = 1, count do
+        strings[i] = can.string()
+        udp:send(strings[i])
+    end
+    
+    done:wait()
+    for i = 1, count do
+        assert(received[i] == strings[i])
+    end
+end
+
 Udp({count=10})
 
 
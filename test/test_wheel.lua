@@ -0,0 +1,17 @@
+local can = require 'vega.can'
+local common = require 'common'
+
+local Wheel = class(common.Test)
+
+-- a delay just short of a turn of the second level lands in its current slot,
+-- the line has to wake for it with no other timer armed
+function Wheel:testTurn()
+    sleep{msec=1}
+    
+    local started = os.time()
+    sleep{msec=65535}
+    
+    assert(os.time() - started >= 65)
+end
+
+Wheel{timeout=70}